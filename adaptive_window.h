@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+
+namespace derecho {
+
+/** A sender's window and the delivery latency it was chosen from. */
+struct window_stats {
+    /** The number of sends that may be in progress at once. */
+    unsigned int window = 0;
+    /** The lowest time from send to delivery at every member seen so far. */
+    std::chrono::nanoseconds base_latency{0};
+    /** The average time from send to delivery over the last adjustment. */
+    std::chrono::nanoseconds latency{0};
+};
+
+/**
+ * Sizes one sender's window between 1 and max_window from how long its
+ * messages take to be delivered everywhere, in the manner of TCP Vegas. With
+ * w sends in progress and an average latency L against the lowest latency
+ * seen, L_min, about w * (1 - L_min / L) of them are queued somewhere rather
+ * than moving. Once per window's worth of deliveries the window grows by one
+ * if less than one send is queued, and shrinks by one if more than three are,
+ * so it settles where the group is kept busy without piling up messages.
+ *
+ * The sender thread reports each send and the predicate thread each
+ * delivery; both take the lock once per message, for a few instructions.
+ */
+class adaptive_window {
+    using clock = std::chrono::steady_clock;
+
+    const unsigned int max_window;
+    std::atomic<unsigned int> window;
+
+    mutable std::mutex mutex;
+    struct send_record {
+        /** The last message index the send covers. */
+        long long int end_index;
+        clock::time_point time;
+    };
+    /** Sends not yet delivered everywhere, oldest first. */
+    std::deque<send_record> in_flight;
+    clock::duration base_latency = clock::duration::max();
+    clock::duration last_latency{0};
+    clock::duration round_latency{0};
+    unsigned int round_samples = 0;
+
+public:
+    /**
+     * @param max_window the largest window, which the group's message
+     * buffers are sized for
+     * @param initial_window the window to start from
+     */
+    adaptive_window(unsigned int max_window, unsigned int initial_window)
+        : max_window(max_window),
+          window(std::max(1u, std::min(initial_window, max_window))) {}
+
+    /** The number of sends that may be in progress at once. */
+    unsigned int get() const { return window.load(std::memory_order_relaxed); }
+
+    /** Records that the send of the messages up to end_index started now. */
+    void sent(long long int end_index) {
+        std::lock_guard<std::mutex> lock(mutex);
+        in_flight.push_back({end_index, clock::now()});
+    }
+
+    /** Records that message index has been delivered everywhere, and adjusts
+     * the window if a send has completed. */
+    void delivered(long long int index) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(in_flight.empty() || in_flight.front().end_index > index) {
+            return;
+        }
+        clock::duration latency = clock::now() - in_flight.front().time;
+        while(!in_flight.empty() && in_flight.front().end_index <= index) {
+            in_flight.pop_front();
+        }
+        base_latency = std::min(base_latency, latency);
+        round_latency += latency;
+        if(++round_samples < get()) {
+            return;
+        }
+        last_latency = round_latency / round_samples;
+        round_latency = clock::duration(0);
+        round_samples = 0;
+        if(last_latency.count() == 0) {
+            return;
+        }
+        double queued = get() * (1.0 - (double)base_latency.count() / last_latency.count());
+        if(queued < 1 && get() < max_window) {
+            window.store(get() + 1, std::memory_order_relaxed);
+        } else if(queued > 3 && get() > 1) {
+            window.store(get() - 1, std::memory_order_relaxed);
+        }
+    }
+
+    window_stats get_stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        window_stats stats;
+        stats.window = get();
+        if(base_latency != clock::duration::max()) {
+            stats.base_latency = std::chrono::duration_cast<std::chrono::nanoseconds>(base_latency);
+        }
+        stats.latency = std::chrono::duration_cast<std::chrono::nanoseconds>(last_latency);
+        return stats;
+    }
+};
+
+}  // namespace derecho
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "lockfree_queue.h"
+
+namespace derecho {
+
+/**
+ * A pool of fixed-size scratch buffers, e.g. for serializing RPC requests and
+ * replies. Any thread may acquire a buffer, use it for the duration of one
+ * call, and release it again; concurrent callers each get their own buffer,
+ * so they never have to share (or lock) one. If the pool is empty a new
+ * buffer is allocated, and at most max_pooled buffers are kept for reuse.
+ */
+class buffer_pool {
+    const size_t buffer_size;
+    mpmc_queue<std::unique_ptr<char[]>> free_buffers;
+
+public:
+    buffer_pool(size_t buffer_size, size_t max_pooled = 64)
+        : buffer_size(buffer_size), free_buffers(max_pooled) {}
+
+    size_t get_buffer_size() const { return buffer_size; }
+
+    std::unique_ptr<char[]> acquire() {
+        std::unique_ptr<char[]> buffer;
+        if(!free_buffers.pop(buffer)) {
+            buffer = std::unique_ptr<char[]>(new char[buffer_size]);
+        }
+        return buffer;
+    }
+
+    void release(std::unique_ptr<char[]>&& buffer) {
+        // If the pool is already full the buffer is simply freed
+        free_buffers.push(std::move(buffer));
+    }
+};
+
+}  // namespace derecho
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#endif
+
+namespace derecho {
+
+inline uint32_t crc32c_software(uint32_t crc, const uint8_t* bytes, size_t size) {
+    struct table {
+        uint32_t entries[256];
+        table() {
+            for(uint32_t i = 0; i < 256; ++i) {
+                uint32_t entry = i;
+                for(int bit = 0; bit < 8; ++bit) {
+                    entry = (entry >> 1) ^ (0x82F63B78 & (0 - (entry & 1)));
+                }
+                entries[i] = entry;
+            }
+        }
+    };
+    static const table crc_table;
+    for(size_t i = 0; i < size; ++i) {
+        crc = crc_table.entries[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/** Uses the SSE4.2 crc32 instruction, 8 bytes at a time; only call this if
+ * the CPU supports SSE4.2. */
+__attribute__((target("sse4.2"))) inline uint32_t crc32c_sse42(uint32_t crc, const uint8_t* bytes, size_t size) {
+    uint64_t crc64 = crc;
+    for(; size >= 8; bytes += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+    for(; size > 0; ++bytes, --size) {
+        crc = _mm_crc32_u8(crc, *bytes);
+    }
+    return crc;
+}
+#endif
+
+/**
+ * Extends a CRC32C (Castagnoli) checksum with size bytes of data. Start with
+ * crc = 0; crc32c(crc32c(0, a, n), b, m) is the checksum of a followed by b.
+ * Uses the SSE4.2 crc32 instruction if the CPU has it, which is checked at
+ * run time so that no special compiler flags are needed.
+ */
+inline uint32_t crc32c(uint32_t crc, const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+#if defined(__x86_64__) && defined(__GNUC__)
+    static const bool have_sse42 = __builtin_cpu_supports("sse4.2");
+    if(have_sse42) {
+        return ~crc32c_sse42(~crc, bytes, size);
+    }
+#endif
+    return ~crc32c_software(~crc, bytes, size);
+}
+
+}  // namespace derecho
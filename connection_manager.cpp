@@ -2,9 +2,17 @@
 
 #include <iostream>
 #include <cassert>
+#include <cerrno>
 #include <set>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 namespace tcp {
+/** epoll user data for the wakeup eventfd */
+static const uint64_t wakeup_event = 1ull << 32;
+
 bool tcp_connections::add_connection(const node_id_t other_id,
                                      const ip_addr_t& other_ip) {
     if(other_id < my_id) {
@@ -31,6 +39,7 @@ bool tcp_connections::add_connection(const node_id_t other_id,
             sockets.erase(other_id);
             return false;
         }
+        watch_socket(other_id);
         return true;
     } else if(other_id > my_id) {
         try {
@@ -43,6 +52,7 @@ bool tcp_connections::add_connection(const node_id_t other_id,
                 return false;
             } else {
                 sockets[remote_id] = std::move(s);
+                watch_socket(remote_id);
                 return true;
             }
         } catch(exception) {
@@ -72,9 +82,33 @@ tcp_connections::tcp_connections(
     node_id_t _my_id, const std::map<node_id_t, ip_addr_t>& ip_addrs,
     uint32_t _port)
     : my_id(_my_id), port(_port) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(epoll_fd >= 0 && wakeup_fd >= 0);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    // Node IDs are 32 bits, so this can't be mistaken for one
+    event.data.u64 = wakeup_event;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &event);
     establish_node_connections(ip_addrs);
 }
 
+tcp_connections::~tcp_connections() {
+    destroy();
+    close(wakeup_fd);
+    close(epoll_fd);
+}
+
+void tcp_connections::watch_socket(node_id_t node_id) {
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = node_id;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sockets.at(node_id).get_socket(), &event) != 0) {
+        std::cerr << "WARNING: failed to watch the connection to node "
+                  << node_id << std::endl;
+    }
+}
+
 void tcp_connections::destroy() {
     std::lock_guard<std::mutex> lock(sockets_mutex);
     sockets.clear();
@@ -116,6 +150,49 @@ bool tcp_connections::add_node(node_id_t new_id, const ip_addr_t new_ip_addr) {
     return add_connection(new_id, new_ip_addr);
 }
 
+void tcp_connections::wait_for_data(std::vector<node_id_t>& ready, int timeout_ms) {
+    epoll_event events[64];
+    int num_events = epoll_wait(epoll_fd, events, 64, timeout_ms);
+    for(int i = 0; i < num_events; ++i) {
+        if(events[i].data.u64 == wakeup_event) {
+            uint64_t count;
+            if(::read(wakeup_fd, &count, sizeof(count)) < 0) {
+                // Already reset by another waiter
+            }
+            continue;
+        }
+        ready.push_back((node_id_t)events[i].data.u64);
+    }
+}
+
+void tcp_connections::interrupt() {
+    uint64_t one = 1;
+    if(::write(wakeup_fd, &one, sizeof(one)) < 0) {
+        std::cerr << "WARNING: failed to interrupt wait_for_data" << std::endl;
+    }
+}
+
+ssize_t tcp_connections::read_available(node_id_t node_id, char* buffer,
+                                        size_t size) {
+    std::lock_guard<std::mutex> lock(sockets_mutex);
+    const auto it = sockets.find(node_id);
+    if(it == sockets.end()) {
+        return -1;
+    }
+    int fd = it->second.get_socket();
+    ssize_t bytes_read = recv(fd, buffer, size, MSG_DONTWAIT);
+    if(bytes_read > 0) {
+        return bytes_read;
+    }
+    if(bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return 0;
+    }
+    // The other end closed the connection, or it failed; stop watching it so
+    // that wait_for_data doesn't keep reporting it
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    return -1;
+}
+
 int32_t tcp_connections::probe_all() {
     std::lock_guard<std::mutex> lock(sockets_mutex);
     for(auto& p : sockets) {
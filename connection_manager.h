@@ -4,6 +4,8 @@
 
 #include <map>
 #include <mutex>
+#include <sys/types.h>
+#include <vector>
 
 namespace tcp {
 using ip_addr_t = std::string;
@@ -15,14 +17,20 @@ class tcp_connections {
     const uint32_t port;
     std::unique_ptr<connection_listener> conn_listener;
     std::map<node_id_t, socket> sockets;
+    /** epoll instance watching every socket for incoming data */
+    int epoll_fd;
+    /** eventfd used by interrupt() to wake up wait_for_data */
+    int wakeup_fd;
     bool add_connection(const node_id_t other_id,
                         const ip_addr_t& other_ip);
+    void watch_socket(node_id_t node_id);
     void establish_node_connections(const std::map<node_id_t, ip_addr_t>& ip_addrs);
 
 public:
     tcp_connections(node_id_t _my_id,
                     const std::map<node_id_t, ip_addr_t>& ip_addrs,
                     uint32_t _port);
+    ~tcp_connections();
     void destroy();
     bool write(node_id_t node_id, char const* buffer, size_t size);
     bool write_all(char const* buffer, size_t size);
@@ -36,5 +44,20 @@ public:
         return it->second.exchange(local, remote);
     }
     int32_t probe_all();
+    /**
+     * Blocks until at least one connection has data to read, timeout_ms
+     * milliseconds pass (-1 waits indefinitely) or interrupt() is called,
+     * then adds the IDs of the nodes whose connections are readable to ready.
+     */
+    void wait_for_data(std::vector<node_id_t>& ready, int timeout_ms);
+    /** Wakes up a thread blocked in wait_for_data. */
+    void interrupt();
+    /**
+     * Reads whatever data has already arrived from node_id, up to size
+     * bytes, without blocking. Returns the number of bytes read (0 if none
+     * were available), or -1 if the connection has been closed or failed,
+     * after which it is no longer watched by wait_for_data.
+     */
+    ssize_t read_available(node_id_t node_id, char* buffer, size_t size);
 };
 }
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+namespace derecho {
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/** Compares four counters per instruction; only call this if the CPU
+ * supports AVX2, and with count >= 4. */
+__attribute__((target("avx2"))) inline long long int min_reduce_avx2(const long long int* values, int count) {
+    __m256i mins = _mm256_loadu_si256((const __m256i*)values);
+    int i;
+    for(i = 4; i + 4 <= count; i += 4) {
+        __m256i next = _mm256_loadu_si256((const __m256i*)(values + i));
+        mins = _mm256_blendv_epi8(next, mins, _mm256_cmpgt_epi64(next, mins));
+    }
+    alignas(32) long long int lanes[4];
+    _mm256_store_si256((__m256i*)lanes, mins);
+    long long int result = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    for(; i < count; ++i) {
+        result = std::min(result, values[i]);
+    }
+    return result;
+}
+#endif
+
+/**
+ * Returns the smallest of count contiguous counters. Uses AVX2 if the CPU has
+ * it, which is checked at run time so that no special compiler flags are
+ * needed; otherwise the loop is simple enough for the compiler to vectorize
+ * on its own.
+ */
+inline long long int min_reduce(const long long int* values, int count) {
+#if defined(__x86_64__) && defined(__GNUC__)
+    static const bool have_avx2 = __builtin_cpu_supports("avx2");
+    if(have_avx2 && count >= 4) {
+        return min_reduce_avx2(values, count);
+    }
+#endif
+    long long int result = std::numeric_limits<long long int>::max();
+    for(int i = 0; i < count; ++i) {
+        result = std::min(result, values[i]);
+    }
+    return result;
+}
+
+/**
+ * The minimum of one counter field (seq_num, stable_num, ...) over the rows
+ * of the SST. The counters never decrease within a view, so the minimum can
+ * only change when the row that holds it does: a refresh normally reads just
+ * that one row, and only when it has moved gathers the field from every row
+ * into a contiguous array and reduces it again. The predicate thread's cost
+ * per evaluation therefore doesn't grow with the group while nothing
+ * changes.
+ *
+ * A column is not thread-safe; each one should only be used by one thread
+ * (normally the SST predicate thread).
+ */
+template <unsigned int N>
+class counter_column {
+    alignas(32) long long int values[N] = {};
+    int num_rows = 0;
+    /** A row whose value was cached_min at the last full refresh. */
+    int min_row = 0;
+    long long int cached_min = std::numeric_limits<long long int>::max();
+
+public:
+    /**
+     * Brings the minimum of field over the first num_rows rows of sst up to
+     * date.
+     * @return true if the minimum differs from the previous refresh (or this
+     * is the first refresh).
+     */
+    template <typename SSTType, typename Row>
+    bool refresh(const SSTType& sst, int num_rows, long long int Row::*field) {
+        if(num_rows == this->num_rows && sst[min_row].*field == cached_min) {
+            return false;
+        }
+        for(int i = 0; i < num_rows; ++i) {
+            values[i] = sst[i].*field;
+        }
+        long long int new_min = min_reduce(values, num_rows);
+        min_row = std::find(values, values + num_rows, new_min) - values;
+        bool changed = num_rows != this->num_rows || new_min != cached_min;
+        this->num_rows = num_rows;
+        cached_min = new_min;
+        return changed;
+    }
+
+    /** The minimum of the column as of the last refresh. */
+    long long int min() const { return cached_min; }
+};
+
+}  // namespace derecho
@@ -1,7 +1,10 @@
 #ifndef DERECHO_GROUP_H
 #define DERECHO_GROUP_H
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <experimental/optional>
 #include <functional>
@@ -15,14 +18,21 @@
 #include <tuple>
 #include <vector>
 
+#include "adaptive_window.h"
+#include "buffer_pool.h"
 #include "connection_manager.h"
+#include "counter_columns.h"
 #include "derecho_caller.h"
 #include "derecho_row.h"
 #include "filewriter.h"
+#include "lockfree_queue.h"
+#include "message_buffer_pool.h"
+#include "message_ring.h"
 #include "mutils-serialization/SerializationMacros.hpp"
 #include "mutils-serialization/SerializationSupport.hpp"
 #include "rdmc/rdmc.h"
 #include "sst/sst.h"
+#include "transport.h"
 
 namespace derecho {
 
@@ -30,6 +40,8 @@ using std::vector;
 
 /** Alias for the type of std::function that is used for message delivery event callbacks. */
 using message_callback = std::function<void(int, long long int, char*, long long int)>;
+/** Called with the first and last sequence numbers of a range of messages. */
+using range_callback = std::function<void(long long int, long long int)>;
 
 /**
  * Bundles together a set of callback functions for message delivery events.
@@ -39,6 +51,24 @@ using message_callback = std::function<void(int, long long int, char*, long long
 struct CallbackSet {
     message_callback global_stability_callback;
     message_callback local_persistence_callback = nullptr;
+    /** Called once per batch of messages written to the persistent log:
+     * every message delivered with a sequence number in the range has been
+     * persisted locally. Cheaper than local_persistence_callback, which is
+     * called for each message. */
+    range_callback local_persistence_range_callback = nullptr;
+    /** Called when a member restarts from its persistent log, for each
+     * message in the recovered log, in order. Since the message may have
+     * been sent in a view that no longer exists, the first argument is the
+     * sender's node ID rather than its rank. */
+    message_callback log_replay_callback = nullptr;
+};
+
+/** A class of message buffers smaller than the group's maximum message. */
+struct message_size_class {
+    /** The largest payload that fits in this class's buffers. */
+    long long unsigned int max_payload_size;
+    /** How many of these buffers to allocate for each member. */
+    unsigned int buffers_per_member;
 };
 
 struct DerechoParams : public mutils::ByteRepresentable {
@@ -49,6 +79,75 @@ struct DerechoParams : public mutils::ByteRepresentable {
     unsigned int timeout_ms = 1;
     rdmc::send_algorithm type = rdmc::BINOMIAL_SEND;
     uint32_t rpc_port = 12487;
+    /** The data plane used to multicast message bodies. This only replaces
+     * RDMC: the SST, and so the group, still runs over RDMA verbs whichever
+     * transport is chosen, so every member needs an RDMA NIC (InfiniBand or
+     * RoCE, which may be a software RoCE device) even with the shared-memory
+     * or TCP transport. */
+    transport_type transport = RDMC_TRANSPORT;
+    /** The port used by transports that make their own connections (TCP). */
+    uint32_t transport_port = 12488;
+    /** If true, consecutive small messages from a sender are packed into a
+     * single transport send while the previous send is still in progress. */
+    bool batching = false;
+    /** The most messages delivered by one evaluation of the delivery
+     * predicate; 0 means no limit. A cap bounds how long the predicate
+     * thread spends in delivery callbacks before checking other predicates. */
+    unsigned int max_deliveries_per_pass = 0;
+    /** How durable a persistent message must be before the local
+     * persistence callback is issued; only used if filename is set. */
+    durability_level durability = DURABILITY_DATA_SYNC;
+    /** How the FileWriter issues its writes and syncs. */
+    write_backend persistence_backend = PWRITEV_BACKEND;
+    /** Seal the persistent log's current segment and start a new one once
+     * its data file reaches this size (0 means no limit). */
+    uint64_t max_log_segment_bytes = 0;
+    /** Seal the persistent log's current segment after this many seconds
+     * (0 means no limit). */
+    uint32_t max_log_segment_seconds = 0;
+    /** The port on which members with a persistent log answer restarting
+     * members' log recovery requests. */
+    uint32_t recovery_port = 12489;
+    /** If true, the persistent log's data file is written with O_DIRECT,
+     * straight from the message buffers and bypassing the page cache. Each
+     * buffer's messages are padded out to whole pages on disk, so small
+     * messages take much more space unless they are batched. */
+    bool direct_io = false;
+    /** How many messages per sender persistence may fall behind: a message
+     * is only sent once every member has persisted the one persistence_window
+     * messages before it, while the delivery window stays window_size. Values
+     * below window_size (including the default, 0) mean window_size. Each
+     * message waiting to be persisted holds a message buffer, so this is
+     * also the number of buffers allocated per member. */
+    unsigned int persistence_window = 0;
+    /** Classes of smaller message buffers. A message is put in a buffer from
+     * the smallest class it fits in (falling back to larger classes if that
+     * one has none free), so small messages don't each take a buffer of
+     * max_payload_size and fill fewer pages. This doesn't save memory: a
+     * full window of buffers of max_payload_size is still allocated for
+     * every member, so that a message being received always finds one. */
+    std::vector<message_size_class> size_classes;
+    /** If true, each sender sizes its own window from how long its messages
+     * take to be delivered everywhere, starting from window_size; see
+     * adaptive_window. How far it may grow is set by sender_buffer_bytes. */
+    bool adaptive_window = false;
+    /** If nonzero, a member that hasn't asked to send anything for this many
+     * milliseconds, while others are sending, skips its turns in the
+     * round-robin order (sends null messages) through the SST, so that it
+     * doesn't hold back the delivery of their messages. 0 leaves an idle
+     * member's turns to the application, as before. */
+    unsigned int null_send_interval_ms = 0;
+    /** With adaptive_window, the memory each sender's messages may take up
+     * in every member's message buffers: a sender's window may grow to as
+     * many maximum-size messages as fit, and buffers are allocated for that
+     * many. 0 (or a budget of fewer than window_size messages) keeps the
+     * window at most window_size. */
+    uint64_t sender_buffer_bytes = 0;
+    /** Identifies this run of the group, so that anything named after it
+     * (the shared-memory transport's segments) can't be mistaken for a
+     * previous run's. The leader picks it when it starts the group and
+     * sends it to joining members; it isn't a constructor parameter. */
+    uint64_t session_token = 0;
 
     DerechoParams(long long unsigned int max_payload_size,
                   long long unsigned int block_size,
@@ -56,23 +155,88 @@ struct DerechoParams : public mutils::ByteRepresentable {
                   unsigned int window_size = 3,
                   unsigned int timeout_ms = 1,
                   rdmc::send_algorithm type = rdmc::BINOMIAL_SEND,
-                  uint32_t rpc_port = 12487)
+                  uint32_t rpc_port = 12487,
+                  transport_type transport = RDMC_TRANSPORT,
+                  uint32_t transport_port = 12488,
+                  bool batching = false,
+                  unsigned int max_deliveries_per_pass = 0,
+                  durability_level durability = DURABILITY_DATA_SYNC,
+                  write_backend persistence_backend = PWRITEV_BACKEND,
+                  uint64_t max_log_segment_bytes = 0,
+                  uint32_t max_log_segment_seconds = 0,
+                  uint32_t recovery_port = 12489,
+                  bool direct_io = false,
+                  unsigned int persistence_window = 0,
+                  std::vector<message_size_class> size_classes = {},
+                  bool adaptive_window = false,
+                  unsigned int null_send_interval_ms = 0,
+                  uint64_t sender_buffer_bytes = 0)
         : max_payload_size(max_payload_size),
           block_size(block_size),
           filename(filename),
           window_size(window_size),
           timeout_ms(timeout_ms),
           type(type),
-          rpc_port(rpc_port) {
+          rpc_port(rpc_port),
+          transport(transport),
+          transport_port(transport_port),
+          batching(batching),
+          max_deliveries_per_pass(max_deliveries_per_pass),
+          durability(durability),
+          persistence_backend(persistence_backend),
+          max_log_segment_bytes(max_log_segment_bytes),
+          max_log_segment_seconds(max_log_segment_seconds),
+          recovery_port(recovery_port),
+          direct_io(direct_io),
+          persistence_window(persistence_window),
+          size_classes(size_classes),
+          adaptive_window(adaptive_window),
+          null_send_interval_ms(null_send_interval_ms),
+          sender_buffer_bytes(sender_buffer_bytes) {
+    }
+
+    /** The largest window a sender may use, for messages of at most
+     * max_msg_size bytes. */
+    unsigned int max_window(long long unsigned int max_msg_size) const {
+        if(!adaptive_window) {
+            return window_size;
+        }
+        return std::max<uint64_t>(window_size, sender_buffer_bytes / max_msg_size);
     }
 
-    DEFAULT_SERIALIZATION_SUPPORT(DerechoParams, max_payload_size, block_size, filename, window_size, timeout_ms, type, rpc_port);
+    /** The number of message buffers each member of the group needs, for
+     * messages of at most max_msg_size bytes. */
+    unsigned int buffers_per_member(long long unsigned int max_msg_size) const {
+        return filename.empty() ? max_window(max_msg_size)
+                                : std::max(max_window(max_msg_size), persistence_window);
+    }
+
+    DEFAULT_SERIALIZATION_SUPPORT(DerechoParams, max_payload_size, block_size, filename, window_size, timeout_ms, type, rpc_port, transport, transport_port, batching, max_deliveries_per_pass, durability, persistence_backend, max_log_segment_bytes, max_log_segment_seconds, recovery_port, direct_io, persistence_window, size_classes, adaptive_window, null_send_interval_ms, sender_buffer_bytes, session_token);
 };
 
 struct __attribute__((__packed__)) header {
     uint32_t header_size;
     uint32_t pause_sending_turns;
     bool cooked_send;
+    /** Nonzero if this message is a batch: the body is then num_batched
+     * messages, each preceded by a batch_entry_header, and each with its own
+     * header. The batch's pause_sending_turns is the number of turns used by
+     * all of the messages in it, minus one. */
+    uint32_t num_batched;
+};
+
+/** Time the sender has spent with a message ready to send but not allowed
+ * to send it, by the window that was closed. A send held back by both is
+ * counted as a delivery stall. */
+struct send_stall_stats {
+    std::chrono::nanoseconds delivery{0};
+    std::chrono::nanoseconds persistence{0};
+};
+
+/** Precedes each message packed into a batch. */
+struct __attribute__((__packed__)) batch_entry_header {
+    /** Size of the message, including its header. */
+    uint32_t size;
 };
 
 class PendingBase {
@@ -123,29 +287,6 @@ auto createPending(PendingResults<T>& pending) {
     return std::make_unique<Pending<T>>(pending);
 };
 
-/**
- * Represents a block of memory used to store a message. This object contains
- * both the array of bytes in which the message is stored and the corresponding
- * RDMA memory region (which has registered that array of bytes as its buffer).
- * This is a move-only type, since memory regions can't be copied.
- */
-struct MessageBuffer {
-    std::unique_ptr<char[]> buffer;
-    std::shared_ptr<rdma::memory_region> mr;
-
-    MessageBuffer() {}
-    MessageBuffer(size_t size) {
-        if(size != 0) {
-            buffer = std::unique_ptr<char[]>(new char[size]);
-            mr = std::make_shared<rdma::memory_region>(buffer.get(), size);
-        }
-    }
-    MessageBuffer(const MessageBuffer&) = delete;
-    MessageBuffer(MessageBuffer&&) = default;
-    MessageBuffer& operator=(const MessageBuffer&) = delete;
-    MessageBuffer& operator=(MessageBuffer&&) = default;
-};
-
 struct Message {
     /** The rank of the message's sender within this group. */
     int sender_rank;
@@ -155,6 +296,15 @@ struct Message {
     long long unsigned int size;
     /** The MessageBuffer that contains the message's body. */
     MessageBuffer message_buffer;
+    /** If the message was unpacked from a batch, points to its header within
+     * the batch. Only the last message of a batch owns the batch's
+     * MessageBuffer; the others have an empty message_buffer. */
+    char* batched_data = nullptr;
+
+    /** The start of the message (its header) in memory. */
+    char* data() const {
+        return batched_data ? batched_data : message_buffer.buffer.get();
+    }
 };
 
 /**
@@ -190,6 +340,8 @@ struct MessageTrackingRow {
  * row-struct */
 template <unsigned int N, typename dispatcherType>
 class DerechoGroup {
+    static_assert(row_layout_is_valid<N>(), "DerechoRow layout is broken");
+
 private:
     /** vector of member id's */
     std::vector<node_id_t> members;
@@ -205,7 +357,22 @@ private:
     /** Send algorithm for constructing a multicast from point-to-point unicast.
      *  Binomial pipeline by default. */
     const rdmc::send_algorithm type;
+    /** The largest number of this node's sends that may be in progress at
+     * once (DerechoParams::max_window); the window itself may be smaller, see
+     * current_window. */
     const unsigned int window_size;
+    /** Sizes this node's window if DerechoParams::adaptive_window is set;
+     * null otherwise. */
+    std::unique_ptr<adaptive_window> send_window;
+    /** See DerechoParams::persistence_window; never less than window_size. */
+    const unsigned int persistence_window;
+    /** Whether small messages are packed into batches; see DerechoParams. */
+    const bool batching;
+    /** Whether the FileWriter writes messages with O_DIRECT; see
+     * DerechoParams. */
+    const bool direct_io;
+    /** See DerechoParams::max_deliveries_per_pass. */
+    const unsigned int max_deliveries_per_pass;
     const CallbackSet callbacks;
     dispatcherType dispatchers;
     tcp::tcp_connections connections;
@@ -214,14 +381,19 @@ private:
     std::mutex pending_results_mutex;
     /** Offset to add to member ranks to form RDMC group numbers. */
     const uint16_t rdmc_group_num_offset;
+    /** The data plane that carries message bodies; shared with the groups
+     * of later views. */
+    std::shared_ptr<MulticastTransport> transport;
     /** false if RDMC groups haven't been created successfully */
     bool rdmc_groups_created = false;
-    unsigned int total_message_buffers;
-    /** Stores message buffers not currently in use. Protected by
-     * msg_state_mtx */
-    std::vector<MessageBuffer> free_message_buffers;
-    std::unique_ptr<char[]> p2pBuffer;
-    std::unique_ptr<char[]> deliveryBuffer;
+    /** Stores message buffers not currently in use; shared with the groups
+     * of later views. Application threads (get_position), the receive
+     * handlers and the delivery/persistence callbacks all take and return
+     * buffers here without locking. */
+    std::shared_ptr<message_buffer_classes> message_buffers;
+    /** Scratch buffers for serializing p2p requests and cooked-send
+     * replies; shared with the groups of later views. */
+    std::shared_ptr<buffer_pool> reply_buffers;
 
     // int send_slot;
     // vector<int> recv_slots;
@@ -237,25 +409,93 @@ private:
     /** next_message is the message that will be sent when send is called the next time.
      * It is boost::none when there is no message to send. */
     std::experimental::optional<Message> next_send;
-    /** Messages that are ready to be sent, but must wait until the current send finishes. */
-    std::queue<Message> pending_sends;
+    /** Messages that are ready to be sent, but must wait until the current send finishes.
+     * send() is the only producer and the sender thread is the only consumer. */
+    spsc_queue<Message> pending_sends;
     /** The message that is currently being sent out using RDMC, or boost::none otherwise. */
     std::experimental::optional<Message> current_send;
 
-    /** Messages that are currently being received. */
-    std::map<long long int, Message> current_receives;
+    /** In batching mode, the batch that messages are currently being packed
+     * into. It is handed to the sender thread when it fills up, or taken by
+     * the sender thread as soon as it is able to send. The open_batch
+     * fields are protected by batch_mtx, which is never acquired before
+     * msg_state_mtx. */
+    std::experimental::optional<Message> open_batch;
+    /** Bytes of open_batch, including its header, used by completed messages. */
+    size_t open_batch_size = 0;
+    uint32_t open_batch_count = 0;
+    /** Sequence-number turns used by the completed messages in open_batch. */
+    uint32_t open_batch_turns = 0;
+    /** True between get_position and send while the application is writing
+     * a message into open_batch. */
+    bool batch_reserved = false;
+    size_t reserved_size = 0;
+    uint32_t reserved_turns = 0;
+    /** Set when the sender thread could have sent open_batch but it was
+     * reserved, so that send() hands it over immediately. */
+    bool sender_wants_batch = false;
+    std::mutex batch_mtx;
+    /** A batch taken from open_batch by the sender thread. */
+    std::experimental::optional<Message> taken_batch;
+    /** In batching mode the window counts sends rather than messages. This
+     * holds the first indices of the last window_size sends started by
+     * get_position. */
+    std::vector<long long int> send_start_indices;
+    long long int sends_started = 0;
+    /** The last indices of the last window_size sends issued by the sender
+     * thread, used the same way in batching mode. */
+    std::vector<long long int> send_end_indices;
+    long long int sends_issued = 0;
+
+    /** Messages that are currently being received, by sequence number. */
+    message_ring<Message> current_receives;
 
     /** Messages that have finished sending/receiving but aren't yet globally stable */
-    std::map<long long int, Message> locally_stable_messages;
+    message_ring<Message> locally_stable_messages;
     /** Messages that are currently being written to persistent storage */
-    std::map<long long int, Message> non_persistent_messages;
+    message_ring<Message> non_persistent_messages;
 
+    /** This node's next message that hasn't been delivered (or, below,
+     * persisted) everywhere yet; these wake the sender as they advance. */
     long long int next_message_to_deliver = 0;
+    long long int next_message_to_persist = 0;
     std::mutex msg_state_mtx;
     std::condition_variable sender_cv;
+    /** True while the sender thread is (about to be) blocked on sender_cv, so
+     * that send() only needs to take msg_state_mtx to wake it up. */
+    std::atomic<bool> sender_waiting{false};
+
+    /** A request for a send position that couldn't be granted right away. */
+    struct position_request {
+        long long unsigned int payload_size;
+        int pause_sending_turns;
+        bool cooked_send;
+        /** Called with the position once it is granted, or with nullptr if
+         * the group is wedged first. */
+        std::function<void(char*)> ready;
+    };
+    /** Guards position_requests, position_granted and position_waiters, and
+     * is held whenever a position is handed out. */
+    std::mutex position_mtx;
+    std::condition_variable position_cv;
+    /** Requests waiting for a position, granted in the order they were made. */
+    std::list<std::shared_ptr<position_request>> position_requests;
+    /** Lets the predicate thread skip position_mtx when nobody is waiting. */
+    std::atomic<bool> has_position_requests{false};
+    /** True from handing out a position until the message written there has
+     * been sent, since there can only be one such message at a time. */
+    bool position_granted = false;
+    /** Threads blocked in get_position_for; wedge waits for them to leave,
+     * since the group may be destroyed right after. */
+    unsigned int position_waiters = 0;
 
     /** The time, in milliseconds, that a sender can wait to send a message before it is considered failed. */
     unsigned int sender_timeout;
+    /** See DerechoParams::null_send_interval_ms; zero if null sends are off. */
+    const std::chrono::milliseconds null_send_interval;
+    /** When the application last asked for a send position; guarded by
+     * position_mtx. */
+    std::chrono::steady_clock::time_point last_position_request;
 
     /** Indicates that the group is being destroyed. */
     std::atomic<bool> thread_shutdown{false};
@@ -272,9 +512,31 @@ private:
     pred_handle stability_pred_handle;
     pred_handle delivery_pred_handle;
     pred_handle sender_pred_handle;
+    /** Only registered if there is a file_writer. */
+    pred_handle persistence_pred_handle;
+    /** Only registered if null sends are on. */
+    pred_handle null_pred_handle;
+
+    /** Column copies of the SST counters read by the predicates, so their
+     * minima are only recomputed when a row changes. Only used by the
+     * predicate thread. */
+    counter_column<N> seq_num_column;
+    counter_column<N> stable_num_column;
+    counter_column<N> delivered_num_column;
+    counter_column<N> persisted_num_column;
 
     std::unique_ptr<FileWriter> file_writer;
 
+    /** Nanoseconds the sender thread has spent with a message ready to send
+     * while the delivery or the persistence window was closed. */
+    std::atomic<int64_t> delivery_stall_ns{0};
+    std::atomic<int64_t> persistence_stall_ns{0};
+
+    /** The number of this node's sends that may be in progress at once. */
+    unsigned int current_window() const {
+        return send_window ? send_window->get() : window_size;
+    }
+
     /** Continuously waits for a new pending send, then sends it. This function
      * implements the sender thread. */
     void send_loop();
@@ -282,13 +544,36 @@ private:
     /** Checks for failures when a sender reaches its timeout. This function
      * implements the timeout thread. */
     void check_failures_loop();
+    /** Skips this node's turns up to the highest index any sender has
+     * reached, if it has been idle for null_send_interval; called by the
+     * timeout thread. */
+    void send_nulls_if_idle();
 
-    std::function<void(persistence::message)> make_file_written_callback();
+    FileWriter::batch_upcall make_file_written_callback();
     bool create_rdmc_groups();
     void initialize_sst_row();
     void register_predicates();
 
     void deliver_message(Message& msg);
+    /** Raises seq_num to the last message received in the round-robin
+     * order, if it has grown, and pushes it; must hold msg_state_mtx. */
+    void update_seq_num();
+    void unpack_batch(int sender_rank, Message&& batch);
+    /** get_position itself, without the checks for requests waiting ahead
+     * of the caller; must hold position_mtx. */
+    char* try_get_position(long long unsigned int payload_size,
+                           int pause_sending_turns, bool cooked_send);
+    char* get_batched_position(long long unsigned int msg_size, bool batchable,
+                               int pause_sending_turns, bool cooked_send);
+    /** False if no position for payload_size can ever be handed out: the
+     * group is wedged or not set up, or the payload is too large. */
+    bool position_possible(long long unsigned int payload_size) const;
+    /** Grants positions to waiting requests, in order, while there is room. */
+    void serve_position_requests();
+    /** Marks the granted position as sent, and passes the turn on. */
+    void position_sent();
+    Message close_batch();
+    void wake_sender();
     template <typename IdClass, unsigned long long tag, typename... Args>
     auto derechoCallerSend(const vector<node_id_t>& nodes, char* buf, Args&&... args);
     template <typename IdClass, unsigned long long tag, typename... Args>
@@ -300,7 +585,7 @@ public:
     DerechoGroup(
         std::vector<node_id_t> _members, node_id_t my_node_id,
         std::shared_ptr<sst::SST<DerechoRow<N>, sst::Mode::Writes>> _sst,
-        std::vector<MessageBuffer>& free_message_buffers,
+        std::shared_ptr<message_buffer_classes> message_buffers,
         dispatcherType _dispatchers,
 	CallbackSet callbacks,
 	const DerechoParams derecho_params,
@@ -316,9 +601,35 @@ public:
     ~DerechoGroup();
 
     void deliver_messages_upto(const std::vector<long long int>& max_indices_for_senders);
-    /** get a pointer into the buffer, to write data into it before sending */
+    /** get a pointer into the buffer, to write data into it before sending;
+     * returns nullptr if there's no room, or if another position is being
+     * written or waited for */
     char* get_position(long long unsigned int payload_size,
                        int pause_sending_turns = 0, bool cooked_send = false);
+    /**
+     * Like get_position, but if there's no room yet, waits (without spinning)
+     * up to timeout for it, behind any requests made earlier. Returns nullptr
+     * if the timeout expires, or if the group is wedged, first.
+     * @param view_lock if given, a lock held by the caller that keeps this
+     * group from being destroyed; it is released while waiting, which is
+     * safe since wedge waits for all waiting threads to leave, and relocked
+     * before returning.
+     */
+    char* get_position_for(std::chrono::nanoseconds timeout,
+                           long long unsigned int payload_size,
+                           int pause_sending_turns = 0, bool cooked_send = false,
+                           std::unique_lock<std::mutex>* view_lock = nullptr);
+    /**
+     * Requests a position without waiting for it. ready is called with the
+     * position once there is room, after any requests made earlier: right
+     * away on this thread if possible, otherwise on the thread that makes
+     * room (the SST predicate thread, or one calling send), so it must not
+     * block. The message written there is sent with send as usual. ready is
+     * called with nullptr if the group is wedged first.
+     */
+    void get_position_async(long long unsigned int payload_size,
+                            std::function<void(char*)> ready,
+                            int pause_sending_turns = 0, bool cooked_send = false);
     /** Note that get_position and send are called one after the another - regexp for using the two is (get_position.send)*
      * This still allows making multiple send calls without acknowledgement; at a single point in time, however,
      * there is only one message per sender in the RDMC pipeline */
@@ -341,11 +652,28 @@ public:
         std::vector<node_id_t> removed_members);
     /** Stops all sending and receiving in this group, in preparation for shutting it down. */
     void wedge();
+    /**
+     * Deletes the sealed segments of the persistent log whose messages are
+     * all covered by an application checkpoint of every message up to and
+     * including checkpoint_seq_num in the current view.
+     * @return the number of bytes of log deleted
+     */
+    uint64_t truncate_log(long long int checkpoint_seq_num);
+    /** How long sends have been held back by each window, in this view and
+     * the views before it. */
+    send_stall_stats get_send_stall_stats() const;
+    /** This node's current window, and the delivery latency it was chosen
+     * from if the window is adaptive. */
+    window_stats get_window_stats() const;
     /** Debugging function; prints the current state of the SST to stdout. */
     void debug_print();
     static long long unsigned int compute_max_msg_size(
         const long long unsigned int max_payload_size,
         const long long unsigned int block_size);
+    /** Creates the message buffers for groups of up to N members with these
+     * parameters, to be shared by the groups of all their views. */
+    static std::shared_ptr<message_buffer_classes> make_message_buffers(
+        const DerechoParams& derecho_params);
 };
 }  // namespace derecho
 
@@ -3,6 +3,8 @@
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstddef>
+#include <cstring>
 #include <limits>
 #include <thread>
 
@@ -40,8 +42,8 @@ size_t index_of(T container, U elem) {
  * @param my_node_id The rank (ID) of this node in the group
  * @param _sst The SST this group will use; created by the GMS (membership
  * service) for this group.
- * @param _free_message_buffers Message buffers to use for RDMC sending/receiving
- * (there must be one for each sender in the group)
+ * @param _message_buffers The message buffers to use for RDMC sending/receiving,
+ * which are shared with the groups of later views
  * @param _max_payload_size The size of the largest possible message that will
  * be sent in this group, in bytes
  * @param _callbacks A set of functions to call when messages have reached
@@ -62,7 +64,7 @@ template <unsigned int N, typename dispatchersType>
 DerechoGroup<N, dispatchersType>::DerechoGroup(
     vector<node_id_t> _members, node_id_t my_node_id,
     std::shared_ptr<sst::SST<DerechoRow<N>, sst::Mode::Writes>> _sst,
-    vector<MessageBuffer>& _free_message_buffers,
+    std::shared_ptr<message_buffer_classes> _message_buffers,
     dispatchersType _dispatchers,
     CallbackSet callbacks,
     const DerechoParams derecho_params,
@@ -74,29 +76,47 @@ DerechoGroup<N, dispatchersType>::DerechoGroup(
       block_size(derecho_params.block_size),
       max_msg_size(compute_max_msg_size(derecho_params.max_payload_size, derecho_params.block_size)),
       type(derecho_params.type),
-      window_size(derecho_params.window_size),
+      window_size(derecho_params.max_window(max_msg_size)),
+      persistence_window(derecho_params.buffers_per_member(max_msg_size)),
+      batching(derecho_params.batching),
+      direct_io(derecho_params.direct_io),
+      max_deliveries_per_pass(derecho_params.max_deliveries_per_pass),
       callbacks(callbacks),
       dispatchers(std::move(_dispatchers)),
       connections(my_node_id, ip_addrs, derecho_params.rpc_port),
       rdmc_group_num_offset(0),
+      transport(make_transport(derecho_params.transport, my_node_id, ip_addrs,
+                               derecho_params.transport_port, derecho_params.session_token)),
+      message_buffers(std::move(_message_buffers)),
+      pending_sends(message_buffers->capacity()),
       sender_timeout(derecho_params.timeout_ms),
+      null_send_interval(derecho_params.null_send_interval_ms),
       sst(_sst) {
     assert(window_size >= 1);
+    if(derecho_params.adaptive_window) {
+        send_window = std::make_unique<adaptive_window>(window_size, derecho_params.window_size);
+    }
+    send_start_indices.resize(window_size);
+    send_end_indices.resize(window_size);
+    current_receives.reserve(window_size * num_members);
+    locally_stable_messages.reserve(window_size * num_members);
+    non_persistent_messages.reserve(persistence_window * num_members);
 
     if(!derecho_params.filename.empty()) {
         file_writer = std::make_unique<FileWriter>(make_file_written_callback(),
-                                                   derecho_params.filename);
-    }
-
-    free_message_buffers.swap(_free_message_buffers);
-    while(free_message_buffers.size() < window_size * num_members) {
-        free_message_buffers.emplace_back(max_msg_size);
+                                                   derecho_params.filename,
+                                                   derecho_params.durability,
+                                                   derecho_params.persistence_backend,
+                                                   segment_policy{derecho_params.max_log_segment_bytes,
+                                                                  derecho_params.max_log_segment_seconds},
+                                                   derecho_params.direct_io);
     }
 
-    total_message_buffers = free_message_buffers.size();
+    message_buffers->reserve(num_members);
+    // A sender turned away for lack of buffers tries again once there are more
+    message_buffers->set_buffers_added_callback(this, [this]() { serve_position_requests(); });
 
-    p2pBuffer = std::unique_ptr<char[]>(new char[derecho_params.max_payload_size]);
-    deliveryBuffer = std::unique_ptr<char[]>(new char[derecho_params.max_payload_size]);
+    reply_buffers = std::make_shared<buffer_pool>(max_msg_size - sizeof(header));
 
     initialize_sst_row();
     bool no_member_failed = true;
@@ -134,6 +154,10 @@ DerechoGroup<N, dispatchersType>::DerechoGroup(
       max_msg_size(old_group.max_msg_size),
       type(old_group.type),
       window_size(old_group.window_size),
+      persistence_window(old_group.persistence_window),
+      batching(old_group.batching),
+      direct_io(old_group.direct_io),
+      max_deliveries_per_pass(old_group.max_deliveries_per_pass),
       callbacks(old_group.callbacks),
       dispatchers(std::move(old_group.dispatchers)),
       connections(my_node_id, ip_addrs, rpc_port),
@@ -141,9 +165,14 @@ DerechoGroup<N, dispatchersType>::DerechoGroup(
       fulfilledList(std::move(old_group.fulfilledList)),
       rdmc_group_num_offset(old_group.rdmc_group_num_offset +
                             old_group.num_members),
-      total_message_buffers(old_group.total_message_buffers),
+      transport(old_group.transport),
+      message_buffers(old_group.message_buffers),
+      pending_sends(message_buffers->capacity()),
       sender_timeout(old_group.sender_timeout),
-      sst(_sst) {
+      null_send_interval(old_group.null_send_interval),
+      sst(_sst),
+      delivery_stall_ns(old_group.delivery_stall_ns.load()),
+      persistence_stall_ns(old_group.persistence_stall_ns.load()) {
     // Make sure rdmc_group_num_offset didn't overflow.
     assert(old_group.rdmc_group_num_offset <=
            std::numeric_limits<uint16_t>::max() - old_group.num_members -
@@ -151,6 +180,17 @@ DerechoGroup<N, dispatchersType>::DerechoGroup(
 
     // Just in case
     old_group.wedge();
+    if(old_group.send_window) {
+        // Start from the old view's window, but measure latency afresh
+        send_window = std::make_unique<adaptive_window>(window_size, old_group.send_window->get());
+    }
+    send_start_indices.resize(window_size);
+    send_end_indices.resize(window_size);
+
+    // Let the transport connect to any node that joined in this view
+    for(const auto& p : ip_addrs) {
+        transport->add_node(p.first, p.second);
+    }
 
     // Convience function that takes a msg from the old group and
     // produces one suitable for this group.
@@ -158,66 +198,115 @@ DerechoGroup<N, dispatchersType>::DerechoGroup(
         msg.sender_rank = member_index;
         msg.index = future_message_index++;
 
-        header* h = (header*)msg.message_buffer.buffer.get();
+        header* h = (header*)msg.data();
         future_message_index += h->pause_sending_turns;
 
         return std::move(msg);
     };
 
-    // Reclaim MessageBuffers from the old group, and supplement them with
-    // additional if the group has grown.
+    // The pool is shared with the old group; it only needs to grow if the
+    // group has.
     lock_guard<mutex> lock(old_group.msg_state_mtx);
-    free_message_buffers.swap(old_group.free_message_buffers);
-    while(total_message_buffers < window_size * num_members) {
-        free_message_buffers.emplace_back(max_msg_size);
-        total_message_buffers++;
-    }
+    message_buffers->reserve(num_members);
+    message_buffers->set_buffers_added_callback(this, [this]() { serve_position_requests(); });
 
-    for(auto& msg : old_group.current_receives) {
-        free_message_buffers.push_back(std::move(msg.second.message_buffer));
-    }
+    old_group.current_receives.for_each([this](long long int seq, Message& msg) {
+        message_buffers->release(std::move(msg.message_buffer));
+    });
     old_group.current_receives.clear();
-    p2pBuffer = std::move(old_group.p2pBuffer);
-    deliveryBuffer = std::move(old_group.deliveryBuffer);
+    // Reuse the old group's tracking storage rather than allocating more
+    current_receives = std::move(old_group.current_receives);
+    current_receives.reserve(window_size * num_members);
+    reply_buffers = old_group.reply_buffers;
 
     // Assume that any locally stable messages failed. If we were the sender
     // than re-attempt, otherwise discard. TODO: Presumably the ragged edge
     // cleanup will want the chance to deliver some of these.
-    for(auto& p : old_group.locally_stable_messages) {
-        if(p.second.size == 0) {
-            continue;
+    // Undelivered messages from one of our batches are a suffix of the batch,
+    // and share its buffer with the batch's last message; they are re-sent
+    // as a batch of just those messages.
+    char* batch_rest = nullptr;
+    uint32_t rest_count = 0;
+    uint32_t rest_turns = 0;
+    old_group.locally_stable_messages.for_each([&](long long int seq, Message& msg) {
+        if(msg.size == 0) {
+            return;
         }
 
-        if(p.second.sender_rank == old_group.member_index) {
-	  pending_sends.push(convert_msg(p.second));
-        } else {
-            free_message_buffers.push_back(std::move(p.second.message_buffer));
+        if(msg.sender_rank == old_group.member_index) {
+            if(msg.batched_data) {
+                if(!batch_rest) {
+                    batch_rest = msg.batched_data - sizeof(batch_entry_header);
+                }
+                rest_count++;
+                rest_turns += 1 + ((header*)msg.batched_data)->pause_sending_turns;
+                if(!msg.message_buffer.buffer) {
+                    return;
+                }
+                char* buf = msg.message_buffer.buffer.get();
+                size_t rest_size = msg.batched_data + msg.size - batch_rest;
+                std::memmove(buf + sizeof(header), batch_rest, rest_size);
+                ((header*)buf)->num_batched = rest_count;
+                ((header*)buf)->pause_sending_turns = rest_turns - 1;
+                msg.size = sizeof(header) + rest_size;
+                msg.batched_data = nullptr;
+                batch_rest = nullptr;
+                rest_count = 0;
+                rest_turns = 0;
+            }
+	  pending_sends.push(convert_msg(msg));
+        } else if(msg.message_buffer.buffer) {
+            message_buffers->release(std::move(msg.message_buffer));
         }
-    }
+    });
     old_group.locally_stable_messages.clear();
+    locally_stable_messages = std::move(old_group.locally_stable_messages);
+    locally_stable_messages.reserve(window_size * num_members);
 
     // Any messages that were being sent should be re-attempted.
     if(old_group.current_send) {
         pending_sends.push(convert_msg(*old_group.current_send));
     }
-    while(!old_group.pending_sends.empty()) {
-        pending_sends.push(convert_msg(old_group.pending_sends.front()));
+    while(Message* msg = old_group.pending_sends.front()) {
+        pending_sends.push(convert_msg(*msg));
         old_group.pending_sends.pop();
     }
+    if(old_group.taken_batch) {
+        pending_sends.push(convert_msg(*old_group.taken_batch));
+    }
     if(old_group.next_send) {
         next_send = convert_msg(*old_group.next_send);
     }
+    // A batch that was still being filled stays open in the new group, along
+    // with any message the application is in the middle of writing into it.
+    {
+        lock_guard<mutex> batch_lock(old_group.batch_mtx);
+        if(old_group.open_batch) {
+            open_batch = std::move(old_group.open_batch);
+            old_group.open_batch = std::experimental::nullopt;
+            open_batch->sender_rank = member_index;
+            open_batch->index = future_message_index;
+            open_batch_size = old_group.open_batch_size;
+            open_batch_count = old_group.open_batch_count;
+            open_batch_turns = old_group.open_batch_turns;
+            batch_reserved = old_group.batch_reserved;
+            reserved_size = old_group.reserved_size;
+            reserved_turns = old_group.reserved_turns;
+            future_message_index += open_batch_turns + (batch_reserved ? reserved_turns : 0);
+            send_start_indices[0] = open_batch->index;
+            sends_started = 1;
+        }
+    }
 
     // If the old group was using persistence, we should transfer its state to the new group
     file_writer = std::move(old_group.file_writer);
     if(file_writer) {
-        file_writer->set_message_written_upcall(make_file_written_callback());
-    }
-    for(auto& entry : old_group.non_persistent_messages) {
-        non_persistent_messages.emplace(entry.first,
-                                        convert_msg(entry.second));
+        file_writer->set_batch_written_upcall(make_file_written_callback());
     }
-    old_group.non_persistent_messages.clear();
+    non_persistent_messages = std::move(old_group.non_persistent_messages);
+    non_persistent_messages.for_each([&](long long int seq, Message& msg) {
+        msg = convert_msg(msg);
+    });
     initialize_sst_row();
     bool no_member_failed = true;
     if(already_failed.size()) {
@@ -242,30 +331,45 @@ DerechoGroup<N, dispatchersType>::DerechoGroup(
 }
 
 template <unsigned int N, typename handlersType>
-std::function<void(persistence::message)> DerechoGroup<N, handlersType>::make_file_written_callback() {
-    return [this](persistence::message m) {
-        //m.sender is an ID, not a rank
-        int sender_rank;
-        for(sender_rank = 0; sender_rank < num_members; ++sender_rank) {
-            if(members[sender_rank] == m.sender) break;
+FileWriter::batch_upcall DerechoGroup<N, handlersType>::make_file_written_callback() {
+    return [this](const std::vector<persistence::message>& batch) {
+        // The batch is in delivery order, so its sequence numbers increase
+        std::vector<long long int> sequence_numbers(batch.size());
+        for(size_t i = 0; i < batch.size(); ++i) {
+            const persistence::message& m = batch[i];
+            //m.sender is an ID, not a rank
+            int sender_rank;
+            for(sender_rank = 0; sender_rank < num_members; ++sender_rank) {
+                if(members[sender_rank] == m.sender) break;
+            }
+            if(callbacks.local_persistence_callback) {
+                callbacks.local_persistence_callback(sender_rank, m.index, m.data,
+                                                     m.length);
+            }
+            sequence_numbers[i] = m.index * num_members + sender_rank;
+        }
+        if(callbacks.local_persistence_range_callback) {
+            callbacks.local_persistence_range_callback(sequence_numbers.front(),
+                                                       sequence_numbers.back());
         }
-        callbacks.local_persistence_callback(sender_rank, m.index, m.data,
-                                             m.length);
 
         // m.data points to the char[] buffer in a MessageBuffer, so we need to find
-        // the msg corresponding to m and put its MessageBuffer on free_message_buffers
-        auto sequence_number = m.index * num_members + sender_rank;
-        {
-            lock_guard<mutex> lock(msg_state_mtx);
-            auto find_result = non_persistent_messages.find(sequence_number);
-            assert(find_result != non_persistent_messages.end());
-            Message &m_msg = find_result->second;
-            free_message_buffers.push_back(std::move(m_msg.message_buffer));
-            non_persistent_messages.erase(find_result);
-            (*sst)[member_index].persisted_num = sequence_number;
-            sst->put();
+        // the msg corresponding to m and return its MessageBuffer to the pool
+        lock_guard<mutex> lock(msg_state_mtx);
+        for(long long int sequence_number : sequence_numbers) {
+            Message* find_result = non_persistent_messages.find(sequence_number);
+            assert(find_result);
+            Message &m_msg = *find_result;
+            // Messages unpacked from a batch share the buffer of the batch's
+            // last message
+            if(m_msg.message_buffer.buffer) {
+                message_buffers->release(std::move(m_msg.message_buffer));
+            }
+            non_persistent_messages.erase(sequence_number);
         }
-
+        // One update and one put for the whole batch
+        (*sst)[member_index].persisted_num = sequence_numbers.back();
+        sst->put(offsetof(DerechoRow<N>, persisted_num), sizeof(long long int));
     };
 }
 
@@ -301,46 +405,60 @@ bool DerechoGroup<N, dispatchersType>::create_rdmc_groups() {
         auto rdmc_receive_handler = [this, groupnum](char *data, size_t size) {
             assert(this->sst);
             util::debug_log().log_event(std::stringstream() << "Locally received message from sender " << groupnum << ": index = " << ((*sst)[member_index].nReceived[groupnum] + 1));
+            if(direct_io && file_writer) {
+                // The FileWriter writes the whole pages that hold the message
+                // (buffers are whole pages), so don't let the bytes a previous
+                // message left after this one's end go to disk with it
+                uintptr_t end = (uintptr_t)data + size;
+                size_t page_size = sysconf(_SC_PAGESIZE);
+                memset((char *)end, 0, (end + page_size - 1) / page_size * page_size - end);
+            }
             lock_guard<mutex> lock(msg_state_mtx);
             header *h = (header *)data;
-            (*sst)[member_index].nReceived[groupnum]++;
-
-            long long int index = (*sst)[member_index].nReceived[groupnum];
-            long long int sequence_number = index * num_members + groupnum;
-
-            // Move message from current_receives to locally_stable_messages.
-            if(groupnum == member_index) {
-                assert(current_send);
-                locally_stable_messages[sequence_number] =
-                    std::move(*current_send);
-                current_send = std::experimental::nullopt;
+            if(h->num_batched > 0) {
+                long long int sequence_number = ((*sst)[member_index].nReceived[groupnum] + 1) * num_members + groupnum;
+                if(groupnum == member_index) {
+                    assert(current_send);
+                    Message batch = std::move(*current_send);
+                    current_send = std::experimental::nullopt;
+                    unpack_batch(groupnum, std::move(batch));
+                } else {
+                    Message* batch = current_receives.find(sequence_number);
+                    assert(batch);
+                    unpack_batch(groupnum, std::move(*batch));
+                    current_receives.erase(sequence_number);
+                }
             } else {
-                auto it = current_receives.find(sequence_number);
-                assert(it != current_receives.end());
-                auto& message = it->second;
-                locally_stable_messages.emplace(sequence_number, std::move(message));
-                current_receives.erase(it);
-            }
-            // Add empty messages to locally_stable_messages for each turn that the sender is skipping.
-            for(unsigned int j = 0; j < h->pause_sending_turns; ++j) {
-                index++;
-                sequence_number += num_members;
                 (*sst)[member_index].nReceived[groupnum]++;
-                locally_stable_messages[sequence_number] = {groupnum, index, 0, 0};
-            }
-
-            auto* min_ptr = std::min_element(std::begin((*sst)[member_index].nReceived),
-                                 &(*sst)[member_index].nReceived[num_members]);
-            int min_index = std::distance(
-                std::begin((*sst)[member_index].nReceived), min_ptr);
-            auto new_seq_num = (*min_ptr + 1) * num_members + min_index - 1;
-            if(new_seq_num > (*sst)[member_index].seq_num) {
-                util::debug_log().log_event(std::stringstream() << "Updating seq_num to "  << new_seq_num);
-                (*sst)[member_index].seq_num = new_seq_num;
-                sst->put();
-            } else {
-                sst->put();
+
+                long long int index = (*sst)[member_index].nReceived[groupnum];
+                long long int sequence_number = index * num_members + groupnum;
+
+                // Move message from current_receives to locally_stable_messages.
+                if(groupnum == member_index) {
+                    assert(current_send);
+                    locally_stable_messages.insert(sequence_number,
+                                                   std::move(*current_send));
+                    current_send = std::experimental::nullopt;
+                } else {
+                    Message* message = current_receives.find(sequence_number);
+                    assert(message);
+                    locally_stable_messages.insert(sequence_number, std::move(*message));
+                    current_receives.erase(sequence_number);
+                }
+                // Add empty messages to locally_stable_messages for each turn that the sender is skipping.
+                for(unsigned int j = 0; j < h->pause_sending_turns; ++j) {
+                    index++;
+                    sequence_number += num_members;
+                    (*sst)[member_index].nReceived[groupnum]++;
+                    locally_stable_messages.insert(sequence_number, {groupnum, index, 0, 0});
+                }
             }
+
+            // Only the changed counters are pushed to the other members
+            sst->put(offsetof(DerechoRow<N>, nReceived) + groupnum * sizeof(long long int),
+                     sizeof(long long int));
+            update_seq_num();
         };
         // Capture rdmc_receive_handler by copy! The reference to it won't be valid
         // after this constructor ends!
@@ -356,36 +474,40 @@ bool DerechoGroup<N, dispatchersType>::create_rdmc_groups() {
         if(groupnum == member_index) {
             // In the group in which this node is the sender, we need to signal the writer thread
             // to continue when we see that one of our messages was delivered.
-            if(!rdmc::create_group(
+            if(!transport->create_group(
                    groupnum + rdmc_group_num_offset, rotated_members, block_size, type,
-                   [this, groupnum](size_t length) -> rdmc::receive_destination {
+                   [this, groupnum](size_t length) -> transport_buffer {
                        assert(false);
-                       return {nullptr, 0};
+                       return {nullptr, nullptr, 0};
                    },
                    receive_handler_plus_notify,
                    [](boost::optional<uint32_t>) {})) {
                 return false;
             }
         } else {
-            if(!rdmc::create_group(
+            if(!transport->create_group(
                    groupnum + rdmc_group_num_offset, rotated_members, block_size, type,
-                   [this, groupnum](size_t length) -> rdmc::receive_destination {
-                       lock_guard<mutex> lock(msg_state_mtx);
-                       assert(!free_message_buffers.empty());
-
+                   [this, groupnum](size_t length) -> transport_buffer {
                        Message msg;
                        msg.sender_rank = groupnum;
-                       msg.index = (*sst)[member_index].nReceived[groupnum] + 1;
                        msg.size = length;
-                       msg.message_buffer =
-                           std::move(free_message_buffers.back());
-                       free_message_buffers.pop_back();
+                       // The windows keep each sender's messages within a
+                       // window of the largest buffers, which
+                       // make_message_buffers reserves for every member, so
+                       // this never finds the classes empty
+                       if(!message_buffers->acquire(length, msg.message_buffer)) {
+                           throw "no free message buffer for a received message";
+                       }
 
-                       rdmc::receive_destination ret{msg.message_buffer.mr, 0};
+                       lock_guard<mutex> lock(msg_state_mtx);
+                       msg.index = (*sst)[member_index].nReceived[groupnum] + 1;
+
+                       transport_buffer ret{msg.message_buffer.buffer.get(), msg.message_buffer.mr,
+                                            msg.message_buffer.offset};
                        auto sequence_number = msg.index * num_members + groupnum;
-                       current_receives[sequence_number] = std::move(msg);
+                       current_receives.insert(sequence_number, std::move(msg));
 
-                       assert(ret.mr->buffer != nullptr);
+                       assert(ret.buffer != nullptr);
                        return ret;
                    },
                    rdmc_receive_handler, [](boost::optional<uint32_t>) {})) {
@@ -406,15 +528,66 @@ void DerechoGroup<N, dispatchersType>::initialize_sst_row() {
         (*sst)[i].stable_num = -1;
         (*sst)[i].delivered_num = -1;
         (*sst)[i].persisted_num = -1;
+        (*sst)[i].null_range_start = -1;
+        (*sst)[i].null_range_end = -1;
     }
-    sst->put();
+    gmssst::put_used(*sst);
     sst->sync_with_members();
 }
 
+template <unsigned int N, typename dispatchersType>
+void DerechoGroup<N, dispatchersType>::update_seq_num() {
+    auto* min_ptr = std::min_element(std::begin((*sst)[member_index].nReceived),
+                                     &(*sst)[member_index].nReceived[num_members]);
+    int min_index = std::distance(std::begin((*sst)[member_index].nReceived), min_ptr);
+    auto new_seq_num = (*min_ptr + 1) * num_members + min_index - 1;
+    if(new_seq_num > (*sst)[member_index].seq_num) {
+        util::debug_log().log_event(std::stringstream() << "Updating seq_num to " << new_seq_num);
+        (*sst)[member_index].seq_num = new_seq_num;
+        sst->put(offsetof(DerechoRow<N>, seq_num), sizeof(long long int));
+    }
+}
+
+/**
+ * Splits a batch that has been completely received into its messages, and
+ * adds each of them to locally_stable_messages under its own sequence number.
+ * The caller must hold msg_state_mtx.
+ */
+template <unsigned int N, typename dispatchersType>
+void DerechoGroup<N, dispatchersType>::unpack_batch(int sender_rank, Message&& batch) {
+    char* buf = batch.message_buffer.buffer.get();
+    const uint32_t num_batched = ((header*)buf)->num_batched;
+    char* entry = buf + ((header*)buf)->header_size;
+    for(uint32_t k = 0; k < num_batched; ++k) {
+        uint32_t size = ((batch_entry_header*)entry)->size;
+        char* data = entry + sizeof(batch_entry_header);
+        long long int index = ++(*sst)[member_index].nReceived[sender_rank];
+        long long int sequence_number = index * num_members + sender_rank;
+
+        Message msg;
+        msg.sender_rank = sender_rank;
+        msg.index = index;
+        msg.size = size;
+        msg.batched_data = data;
+        // The last message keeps the buffer alive until all of them are done
+        if(k + 1 == num_batched) {
+            msg.message_buffer = std::move(batch.message_buffer);
+        }
+        locally_stable_messages.insert(sequence_number, std::move(msg));
+
+        for(unsigned int j = 0; j < ((header*)data)->pause_sending_turns; ++j) {
+            index = ++(*sst)[member_index].nReceived[sender_rank];
+            sequence_number += num_members;
+            locally_stable_messages.insert(sequence_number, {sender_rank, index, 0, 0});
+        }
+        entry = data + size;
+    }
+}
+
 template <unsigned int N, typename dispatchersType>
   void DerechoGroup<N, dispatchersType>::deliver_message(Message& msg) {
     if(msg.size > 0) {
-        char* buf = msg.message_buffer.buffer.get();
+        char* buf = msg.data();
         header* h = (header*)(buf);
         // cooked send
         if(h->cooked_send) {
@@ -434,14 +607,15 @@ template <unsigned int N, typename dispatchersType>
                 }
             }
             if(in_dest || dest_size == 0) {
-                auto max_payload_size = max_msg_size - sizeof(header);
+                auto max_payload_size = reply_buffers->get_buffer_size();
                 size_t reply_size = 0;
+                std::unique_ptr<char[]> reply_buffer = reply_buffers->acquire();
                 dispatchers.handle_receive(
-                    buf, payload_size, [this, &reply_size, &max_payload_size](
+                    buf, payload_size, [&reply_buffer, &reply_size, &max_payload_size](
                                            size_t size) -> char* {
                         reply_size = size;
                         if(reply_size <= max_payload_size) {
-                            return deliveryBuffer.get();
+                            return reply_buffer.get();
                         } else {
                             return nullptr;
                         }
@@ -450,7 +624,7 @@ template <unsigned int N, typename dispatchersType>
                     node_id_t id = members[msg.sender_rank];
                     if(id == members[member_index]) {
                         dispatchers.handle_receive(
-                            deliveryBuffer.get(), reply_size,
+                            reply_buffer.get(), reply_size,
                             [](size_t size) -> char* { assert(false); });
                         if(dest_size == 0) {
                             std::lock_guard<std::mutex> lock(
@@ -460,10 +634,11 @@ template <unsigned int N, typename dispatchersType>
                             toFulfillQueue.pop();
                         }
                     } else {
-                        connections.write(id, deliveryBuffer.get(),
+                        connections.write(id, reply_buffer.get(),
                                           reply_size);
                     }
                 }
+                reply_buffers->release(std::move(reply_buffer));
             }
         }
         // raw send
@@ -474,15 +649,16 @@ template <unsigned int N, typename dispatchersType>
         if(file_writer) {
             // msg.sender_rank is the 0-indexed rank within this group, but
             // persistence::message needs the sender's globally unique ID
+            // too; the rank orders messages with the same index in the log
             persistence::message msg_for_filewriter{buf + h->header_size,
                                                     msg.size, (uint32_t)(*sst)[member_index].vid,
                                                     members[msg.sender_rank], (uint64_t)msg.index,
-                                                    h->cooked_send};
+                                                    h->cooked_send, (uint16_t)msg.sender_rank};
             auto sequence_number = msg.index * num_members + msg.sender_rank;
-            non_persistent_messages.emplace(sequence_number, std::move(msg));
+            non_persistent_messages.insert(sequence_number, std::move(msg));
             file_writer->write_message(msg_for_filewriter);
-        } else {
-            free_message_buffers.push_back(std::move(msg.message_buffer));
+        } else if(msg.message_buffer.buffer) {
+            message_buffers->release(std::move(msg.message_buffer));
         }
     }
 }
@@ -501,10 +677,10 @@ void DerechoGroup<N, dispatchersType>::deliver_messages_upto(
                      max_indices_for_senders[sender] * num_members + sender);
     }
     for(auto seq_num = curr_seq_num; seq_num <= max_seq_num; seq_num++) {
-        auto msg_ptr = locally_stable_messages.find(seq_num);
-        if(msg_ptr != locally_stable_messages.end()) {
-            deliver_message(msg_ptr->second);
-            locally_stable_messages.erase(msg_ptr);
+        Message* msg_ptr = locally_stable_messages.find(seq_num);
+        if(msg_ptr) {
+            deliver_message(*msg_ptr);
+            locally_stable_messages.erase(seq_num);
         }
     }
 }
@@ -515,19 +691,18 @@ void DerechoGroup<N, dispatchersType>::register_predicates() {
         const sst::SST<DerechoRow<N>, sst::Mode::Writes>& sst) { return true; };
     auto stability_trig =
         [this](sst::SST<DerechoRow<N>, sst::Mode::Writes>& sst) {
-            // compute the min of the seq_num
-            long long int min_seq_num = sst[0].seq_num;
-            for(int i = 0; i < num_members; ++i) {
-                if(sst[i].seq_num < min_seq_num) {
-                    min_seq_num = sst[i].seq_num;
-                }
+            // compute the min of the seq_num; stable_num can only change if
+            // it has
+            if(!seq_num_column.refresh(sst, num_members, &DerechoRow<N>::seq_num)) {
+                return;
             }
+            long long int min_seq_num = seq_num_column.min();
             if(min_seq_num > sst[member_index].stable_num) {
                 util::debug_log().log_event(std::stringstream()
                                             << "Updating stable_num to "
                                             << min_seq_num);
                 sst[member_index].stable_num = min_seq_num;
-                sst.put();
+                sst.put(offsetof(DerechoRow<N>, stable_num), sizeof(long long int));
             }
         };
     stability_pred_handle = sst->predicates.insert(
@@ -539,46 +714,112 @@ void DerechoGroup<N, dispatchersType>::register_predicates() {
         sst::SST<DerechoRow<N>, sst::Mode::Writes>& sst) {
         lock_guard<mutex> lock(msg_state_mtx);
         // compute the min of the stable_num
-        long long int min_stable_num = sst[0].stable_num;
-        for(int i = 0; i < num_members; ++i) {
-            if(sst[i].stable_num < min_stable_num) {
-                min_stable_num = sst[i].stable_num;
-            }
-        }
-
-        if(!locally_stable_messages.empty()) {
+        stable_num_column.refresh(sst, num_members, &DerechoRow<N>::stable_num);
+        long long int min_stable_num = stable_num_column.min();
+
+        // Deliver every stable message in one pass (up to the cap), and
+        // publish the new delivered_num once at the end.
+        unsigned int num_delivered = 0;
+        while(!locally_stable_messages.empty()
+              && (max_deliveries_per_pass == 0 || num_delivered < max_deliveries_per_pass)) {
             long long int least_undelivered_seq_num =
-                locally_stable_messages.begin()->first;
-            if(least_undelivered_seq_num <= min_stable_num) {
-                util::debug_log().log_event(std::stringstream() << "Can deliver a locally stable message: min_stable_num=" << min_stable_num << " and least_undelivered_seq_num=" << least_undelivered_seq_num);
-                Message& msg = locally_stable_messages.begin()->second;
-                deliver_message(msg);
-                sst[member_index].delivered_num = least_undelivered_seq_num;
-                //                sst.put (offsetof (DerechoRow<N>,
-                //                delivered_num), sizeof
-                //                (least_undelivered_seq_num));
-                sst.put();
-                locally_stable_messages.erase(locally_stable_messages.begin());
+                locally_stable_messages.first();
+            if(least_undelivered_seq_num > min_stable_num) {
+                break;
             }
+            util::debug_log().log_event(std::stringstream() << "Can deliver a locally stable message: min_stable_num=" << min_stable_num << " and least_undelivered_seq_num=" << least_undelivered_seq_num);
+            Message& msg = locally_stable_messages.front();
+            deliver_message(msg);
+            sst[member_index].delivered_num = least_undelivered_seq_num;
+            locally_stable_messages.erase(least_undelivered_seq_num);
+            num_delivered++;
+        }
+        if(num_delivered > 0) {
+            sst.put(offsetof(DerechoRow<N>, delivered_num), sizeof(long long int));
         }
     };
     delivery_pred_handle = sst->predicates.insert(delivery_pred, delivery_trig, sst::PredicateType::RECURRENT);
 
+    // The delivery and persistence windows each wake the sender (and any
+    // position waiters) as they open, independently of each other; whether
+    // a message can actually go out is decided by ready_to_send and
+    // try_get_position, which check both
     auto sender_pred = [this](const sst::SST<DerechoRow<N>, sst::Mode::Writes> &sst) {
         long long int seq_num = next_message_to_deliver * num_members + member_index;
-        for (int i = 0; i < num_members; ++i) {
-            if (sst[i].delivered_num < seq_num || (file_writer && sst[i].persisted_num < seq_num)) {
-                return false;
-            }
-        }
-        return true;
+        delivered_num_column.refresh(sst, num_members, &DerechoRow<N>::delivered_num);
+        return delivered_num_column.min() >= seq_num;
     };
     auto sender_trig = [this](sst::SST<DerechoRow<N>, sst::Mode::Writes> & sst) {
+        // Catch up with every message of ours that has been delivered
+        // everywhere, so the window sees each delivery as soon as the
+        // delivered_num puts show it rather than one per predicate pass
+        long long int last_delivered = (delivered_num_column.min() - member_index) / num_members;
+        if(send_window) {
+            send_window->delivered(last_delivered);
+        }
         sender_cv.notify_all();
-        next_message_to_deliver++;
+        next_message_to_deliver = last_delivered + 1;
+        // The window may have room for a waiting request now
+        serve_position_requests();
     };
     sender_pred_handle = sst->predicates.insert(sender_pred, sender_trig,
                                                 sst::PredicateType::RECURRENT);
+
+    if(file_writer) {
+        auto persistence_pred = [this](const sst::SST<DerechoRow<N>, sst::Mode::Writes>& sst) {
+            long long int seq_num = next_message_to_persist * num_members + member_index;
+            persisted_num_column.refresh(sst, num_members, &DerechoRow<N>::persisted_num);
+            return persisted_num_column.min() >= seq_num;
+        };
+        auto persistence_trig = [this](sst::SST<DerechoRow<N>, sst::Mode::Writes>& sst) {
+            sender_cv.notify_all();
+            next_message_to_persist++;
+            serve_position_requests();
+        };
+        persistence_pred_handle = sst->predicates.insert(persistence_pred, persistence_trig,
+                                                         sst::PredicateType::RECURRENT);
+    }
+
+    if(null_send_interval.count() == 0) {
+        return;
+    }
+    // Counts a sender's null range as received once everything it sent
+    // before the range has been, with an empty message for each turn, just
+    // like the turns a message pauses for. The predicate only reads the SST,
+    // so msg_state_mtx is taken only when there is a range to count
+    auto null_pred = [this](const sst::SST<DerechoRow<N>, sst::Mode::Writes>& sst) {
+        for(int sender = 0; sender < num_members; ++sender) {
+            long long int num_received = sst[member_index].nReceived[sender];
+            if(sst[sender].null_range_start == num_received + 1
+               && sst[sender].null_range_end > num_received) {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto null_trig = [this](sst::SST<DerechoRow<N>, sst::Mode::Writes>& sst) {
+        lock_guard<mutex> lock(msg_state_mtx);
+        bool received = false;
+        for(int sender = 0; sender < num_members; ++sender) {
+            volatile long long int& num_received = sst[member_index].nReceived[sender];
+            long long int start = sst[sender].null_range_start;
+            long long int end = sst[sender].null_range_end;
+            if(end <= num_received || num_received + 1 != start) {
+                continue;
+            }
+            for(long long int index = start; index <= end; ++index) {
+                locally_stable_messages.insert(index * num_members + sender, {sender, index, 0, 0});
+            }
+            num_received = end;
+            sst.put(offsetof(DerechoRow<N>, nReceived) + sender * sizeof(long long int),
+                    sizeof(long long int));
+            received = true;
+        }
+        if(received) {
+            update_seq_num();
+        }
+    };
+    null_pred_handle = sst->predicates.insert(null_pred, null_trig, sst::PredicateType::RECURRENT);
 }
 
 template <unsigned int N, typename dispatchersType>
@@ -603,21 +844,60 @@ long long unsigned int DerechoGroup<N, dispatchersType>::compute_max_msg_size(
     return max_msg_size;
 }
 
+template <unsigned int N, typename dispatchersType>
+std::shared_ptr<message_buffer_classes> DerechoGroup<N, dispatchersType>::make_message_buffers(
+    const DerechoParams& derecho_params) {
+    auto max_msg_size = compute_max_msg_size(derecho_params.max_payload_size, derecho_params.block_size);
+    bool register_memory = derecho_params.transport == RDMC_TRANSPORT;
+    std::vector<message_size_class> size_classes = derecho_params.size_classes;
+    std::sort(size_classes.begin(), size_classes.end(),
+              [](const message_size_class& a, const message_size_class& b) {
+                  return a.max_payload_size < b.max_payload_size;
+              });
+    auto message_buffers = std::make_shared<message_buffer_classes>();
+    long long unsigned int last_msg_size = 0;
+    for(const message_size_class& size_class : size_classes) {
+        auto msg_size = compute_max_msg_size(size_class.max_payload_size, derecho_params.block_size);
+        // Classes that round up to the same (or the maximum) size are redundant
+        if(msg_size <= last_msg_size || msg_size >= max_msg_size || size_class.buffers_per_member == 0) {
+            continue;
+        }
+        message_buffers->add_class(msg_size, register_memory, size_class.buffers_per_member,
+                                   size_class.buffers_per_member * N);
+        last_msg_size = msg_size;
+    }
+    // However messages are spread over the smaller classes, this one holds a
+    // full window of them for every member, so that the receive path, which
+    // can't turn a message away or wait, always finds a buffer
+    message_buffers->add_class(max_msg_size, register_memory,
+                               derecho_params.buffers_per_member(max_msg_size),
+                               derecho_params.buffers_per_member(max_msg_size) * N);
+    return message_buffers;
+}
+
 template <unsigned int N, typename dispatchersType>
 void DerechoGroup<N, dispatchersType>::wedge() {
     bool thread_shutdown_existing = thread_shutdown.exchange(true);
     if(thread_shutdown_existing) {  // Wedge has already been called
         return;
     }
+    message_buffers->clear_buffers_added_callback(this);
 
     sst->predicates.remove(stability_pred_handle);
     sst->predicates.remove(delivery_pred_handle);
     sst->predicates.remove(sender_pred_handle);
+    if(file_writer) {
+        sst->predicates.remove(persistence_pred_handle);
+    }
+    if(null_send_interval.count() > 0) {
+        sst->predicates.remove(null_pred_handle);
+    }
 
     for(int i = 0; i < num_members; ++i) {
-        rdmc::destroy_group(i + rdmc_group_num_offset);
+        transport->destroy_group(i + rdmc_group_num_offset);
     }
 
+    connections.interrupt();
     if(rpc_thread.joinable()) {
         rpc_thread.join();
     }
@@ -627,48 +907,154 @@ void DerechoGroup<N, dispatchersType>::wedge() {
     if(sender_thread.joinable()) {
         sender_thread.join();
     }
+
+    // Nothing more will be sent; turn away waiting requests, and wait for
+    // the threads blocked in get_position_for to leave
+    unique_lock<mutex> lock(position_mtx);
+    auto turned_away = std::move(position_requests);
+    position_requests.clear();
+    has_position_requests = false;
+    lock.unlock();
+    for(const auto& request : turned_away) {
+        request->ready(nullptr);
+    }
+    lock.lock();
+    position_cv.wait(lock, [this]() { return position_waiters == 0; });
 }
 
 template <unsigned int N, typename dispatchersType>
 void DerechoGroup<N, dispatchersType>::send_loop() {
-    auto should_send = [&]() {
-        if(!rdmc_groups_created) {
-            return false;
+    // Which window held back the message the sender is waiting to send, and
+    // since when; the time is charged when the reason changes
+    enum { NOT_STALLED, DELIVERY_STALL, PERSISTENCE_STALL } stall = NOT_STALLED;
+    auto stall_start = std::chrono::steady_clock::now();
+    auto set_stall = [&](decltype(stall) reason) {
+        if(reason == stall) {
+            return;
         }
-        if(pending_sends.empty()) {
-            return false;
+        auto now = std::chrono::steady_clock::now();
+        int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - stall_start).count();
+        if(stall == DELIVERY_STALL) {
+            delivery_stall_ns += elapsed;
+        } else if(stall == PERSISTENCE_STALL) {
+            persistence_stall_ns += elapsed;
         }
-        Message &msg = pending_sends.front();
+        stall = reason;
+        stall_start = now;
+    };
+    auto ready_to_send = [&](const Message& msg) {
         if((*sst)[member_index].nReceived[member_index] < msg.index - 1) {
             return false;
         }
+        // Receivers take a message's index from how many they have received,
+        // so nothing after a null range is sent until every member has
+        // counted the range
+        long long int null_range_end = (*sst)[member_index].null_range_end;
+        if(null_range_end >= 0 && msg.index > null_range_end) {
+            for(int i = 0; i < num_members; ++i) {
+                if((*sst)[i].nReceived[member_index] < null_range_end) {
+                    set_stall(DELIVERY_STALL);
+                    return false;
+                }
+            }
+        }
 
+        const unsigned int window = current_window();
+        long long int window_end = msg.index - window;
+        long long int persistence_window_end = msg.index - persistence_window;
+        if(batching) {
+            if(sends_issued < window) {
+                set_stall(NOT_STALLED);
+                return true;
+            }
+            window_end = send_end_indices[(sends_issued - window) % window_size];
+            persistence_window_end = std::min(window_end, persistence_window_end);
+        }
         for (int i = 0; i < num_members; ++i) {
-            if ((*sst)[i].delivered_num < (msg.index - window_size) * num_members + member_index
-                    || (file_writer && (*sst)[i].persisted_num < (msg.index - window_size) * num_members + member_index)) {
+            if ((*sst)[i].delivered_num < window_end * num_members + member_index) {
+                set_stall(DELIVERY_STALL);
                 return false;
             }
         }
+        if(file_writer) {
+            // Persistence may lag behind delivery by up to persistence_window
+            for(int i = 0; i < num_members; ++i) {
+                if((*sst)[i].persisted_num < persistence_window_end * num_members + member_index) {
+                    set_stall(PERSISTENCE_STALL);
+                    return false;
+                }
+            }
+        }
 
+        set_stall(NOT_STALLED);
+        return true;
+    };
+    auto should_send = [&]() {
+        if(!rdmc_groups_created) {
+            return false;
+        }
+        Message* msg_ptr = pending_sends.front();
+        if(msg_ptr) {
+            return ready_to_send(*msg_ptr);
+        }
+        set_stall(NOT_STALLED);
+        if(!batching) {
+            return false;
+        }
+        // Nothing is queued, so take whatever has been packed into the open
+        // batch so far.
+        lock_guard<mutex> batch_lock(batch_mtx);
+        if(!open_batch || open_batch_count == 0 || !ready_to_send(*open_batch)) {
+            return false;
+        }
+        if(batch_reserved) {
+            sender_wants_batch = true;
+            return false;
+        }
+        taken_batch = close_batch();
         return true;
     };
     auto should_wake = [&]() { return thread_shutdown || should_send(); };
     try {
         unique_lock<mutex> lock(msg_state_mtx);
         while(!thread_shutdown) {
+            // Announce that we may block before re-checking pending_sends, so
+            // that a concurrent send() either sees the flag or its message is
+            // seen by should_wake.
+            sender_waiting = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
             sender_cv.wait(lock, should_wake);
+            sender_waiting = false;
             if(!thread_shutdown) {
-                current_send = std::move(pending_sends.front());
+                bool from_open_batch = bool(taken_batch);
+                if(from_open_batch) {
+                    current_send = std::move(*taken_batch);
+                    taken_batch = std::experimental::nullopt;
+                } else {
+                    current_send = std::move(*pending_sends.front());
+                }
                 util::debug_log().log_event(
                     std::stringstream()
                     << "Calling send on message " << current_send->index
                     << " from sender " << current_send->sender_rank);
-                if(!rdmc::send(member_index + rdmc_group_num_offset,
-                               current_send->message_buffer.mr, 0,
-                               current_send->size)) {
-                    throw "rdmc::send returned false";
+                header* h = (header*)current_send->message_buffer.buffer.get();
+                if(send_window) {
+                    send_window->sent(current_send->index + h->pause_sending_turns);
+                }
+                if(!transport->send(member_index + rdmc_group_num_offset,
+                                    {current_send->message_buffer.buffer.get(),
+                                     current_send->message_buffer.mr,
+                                     current_send->message_buffer.offset},
+                                    current_send->size)) {
+                    throw "transport send returned false";
+                }
+                if(batching) {
+                    send_end_indices[sends_issued % window_size] = current_send->index + h->pause_sending_turns;
+                    sends_issued++;
+                }
+                if(!from_open_batch) {
+                    pending_sends.pop();
                 }
-                pending_sends.pop();
             }
         }
         cout << "DerechoGroup send thread shutting down" << endl;
@@ -682,31 +1068,271 @@ template <unsigned int N, typename dispatchersType>
 void DerechoGroup<N, dispatchersType>::check_failures_loop() {
     while(!thread_shutdown) {
         std::this_thread::sleep_for(milliseconds(sender_timeout));
-        if(sst) sst->put();
+        if(sst) gmssst::put_used(*sst);
+        if(null_send_interval.count() > 0 && rdmc_groups_created) {
+            send_nulls_if_idle();
+        }
+    }
+}
+
+/**
+ * Other members' messages can only be delivered once this node has sent (or
+ * skipped) its turns before them, so when the application has nothing to
+ * send, they would wait for its next message. Instead, once it has been idle
+ * for null_send_interval, this node publishes the range of turns up to the
+ * highest index any sender has reached as null messages, in its SST row
+ * alone: each member counts the range as received after everything this node
+ * sent before it, and no RDMC transfer is needed. Only one range is
+ * outstanding at a time, so the start and end of a range can't be read from
+ * two different ranges.
+ */
+template <unsigned int N, typename dispatchersType>
+void DerechoGroup<N, dispatchersType>::send_nulls_if_idle() {
+    // Nobody can be handed a position while the turns are taken
+    lock_guard<mutex> position_lock(position_mtx);
+    if(thread_shutdown || position_granted || !position_requests.empty()) {
+        return;
+    }
+    if(std::chrono::steady_clock::now() - last_position_request < null_send_interval) {
+        return;
+    }
+    lock_guard<mutex> batch_lock(batch_mtx);
+    if(open_batch) {
+        return;
+    }
+    long long int highest_index = *std::max_element(std::begin((*sst)[member_index].nReceived),
+                                                    &(*sst)[member_index].nReceived[num_members]);
+    if(highest_index < future_message_index) {
+        return;
     }
+    // The previous range must have been counted everywhere
+    for(int i = 0; i < num_members; ++i) {
+        if((*sst)[i].nReceived[member_index] < (*sst)[member_index].null_range_end) {
+            return;
+        }
+    }
+    util::debug_log().log_event(std::stringstream() << "Skipping turns " << future_message_index
+                                                    << " to " << highest_index);
+    (*sst)[member_index].null_range_start = future_message_index;
+    (*sst)[member_index].null_range_end = highest_index;
+    sst->put(offsetof(DerechoRow<N>, null_range_start), 2 * sizeof(long long int));
+    future_message_index = highest_index + 1;
 }
 
 template <unsigned int N, typename dispatchersType>
 bool DerechoGroup<N, dispatchersType>::send() {
-    lock_guard<mutex> lock(msg_state_mtx);
     if(thread_shutdown || !rdmc_groups_created) {
         return false;
     }
+    if(batching) {
+        unique_lock<mutex> batch_lock(batch_mtx);
+        if(batch_reserved) {
+            assert(open_batch);
+            open_batch_size += reserved_size;
+            open_batch_count++;
+            open_batch_turns += reserved_turns;
+            batch_reserved = false;
+            // Hand the batch over if the sender is waiting for it or it can't
+            // hold another message; otherwise leave it for the sender thread
+            // to take when it is ready.
+            bool full = open_batch_size + sizeof(batch_entry_header) + sizeof(header) >= max_msg_size;
+            bool hand_over = sender_wants_batch || full;
+            bool first = open_batch_count == 1;
+            if(hand_over) {
+                pending_sends.push(close_batch());
+            }
+            batch_lock.unlock();
+            if(hand_over || first) {
+                wake_sender();
+            }
+            position_sent();
+            return true;
+        }
+    }
     assert(next_send);
-    pending_sends.push(std::move(*next_send));
+    if(!pending_sends.push(std::move(*next_send))) {
+        return false;
+    }
     next_send = std::experimental::nullopt;
-    sender_cv.notify_all();
+    wake_sender();
+    position_sent();
     return true;
 }
 
+template <unsigned int N, typename dispatchersType>
+void DerechoGroup<N, dispatchersType>::wake_sender() {
+    // Only wake the sender thread if it might be sleeping. The lock ensures it
+    // has actually blocked on sender_cv before it is notified.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(sender_waiting) {
+        lock_guard<mutex> lock(msg_state_mtx);
+        sender_cv.notify_all();
+    }
+}
+
+/**
+ * Finishes the header of open_batch and removes it from the group so it can
+ * be sent. The caller must hold batch_mtx.
+ */
+template <unsigned int N, typename dispatchersType>
+Message DerechoGroup<N, dispatchersType>::close_batch() {
+    Message batch = std::move(*open_batch);
+    open_batch = std::experimental::nullopt;
+    header* h = (header*)batch.message_buffer.buffer.get();
+    h->num_batched = open_batch_count;
+    h->pause_sending_turns = open_batch_turns - 1;
+    batch.size = open_batch_size;
+    sender_wants_batch = false;
+    return batch;
+}
+
 template <unsigned int N, typename dispatchersType>
 char* DerechoGroup<N, dispatchersType>::get_position(
+    long long unsigned int payload_size,
+    int pause_sending_turns, bool cooked_send) {
+    lock_guard<mutex> lock(position_mtx);
+    // Requests already waiting go first
+    if(position_granted || !position_requests.empty()) {
+        return nullptr;
+    }
+    char* buf = try_get_position(payload_size, pause_sending_turns, cooked_send);
+    position_granted = buf != nullptr;
+    return buf;
+}
+
+template <unsigned int N, typename dispatchersType>
+bool DerechoGroup<N, dispatchersType>::position_possible(long long unsigned int payload_size) const {
+    if(thread_shutdown || !rdmc_groups_created) {
+        return false;
+    }
+    if(payload_size + sizeof(header) > max_msg_size) {
+        cout << "Can't send messages of size larger than the maximum message "
+                "size which is equal to "
+             << max_msg_size << endl;
+        return false;
+    }
+    return true;
+}
+
+template <unsigned int N, typename dispatchersType>
+char* DerechoGroup<N, dispatchersType>::get_position_for(
+    std::chrono::nanoseconds timeout, long long unsigned int payload_size,
+    int pause_sending_turns, bool cooked_send, std::unique_lock<std::mutex>* view_lock) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    unique_lock<mutex> lock(position_mtx);
+    if(!position_possible(payload_size)) {
+        return nullptr;
+    }
+    if(!position_granted && position_requests.empty()) {
+        char* buf = try_get_position(payload_size, pause_sending_turns, cooked_send);
+        if(buf) {
+            position_granted = true;
+            return buf;
+        }
+    }
+
+    struct grant {
+        bool done = false;
+        char* buf = nullptr;
+    };
+    auto result = std::make_shared<grant>();
+    auto request = std::make_shared<position_request>(position_request{
+        payload_size, pause_sending_turns, cooked_send, [this, result](char* buf) {
+            lock_guard<mutex> lock(position_mtx);
+            result->buf = buf;
+            result->done = true;
+            position_cv.notify_all();
+        }});
+    position_requests.push_back(request);
+    has_position_requests = true;
+    position_waiters++;
+    if(view_lock) {
+        view_lock->unlock();
+    }
+    position_cv.wait_until(lock, deadline, [&]() { return result->done; });
+    if(!result->done) {
+        auto queued = std::find(position_requests.begin(), position_requests.end(), request);
+        if(queued != position_requests.end()) {
+            position_requests.erase(queued);
+            has_position_requests = !position_requests.empty();
+        } else {
+            // The position was granted just as the timeout expired; take it,
+            // since nobody else will send the message
+            position_cv.wait(lock, [&]() { return result->done; });
+        }
+    }
+    position_waiters--;
+    if(position_waiters == 0) {
+        position_cv.notify_all();
+    }
+    lock.unlock();
+    if(view_lock) {
+        view_lock->lock();
+    }
+    return result->buf;
+}
+
+template <unsigned int N, typename dispatchersType>
+void DerechoGroup<N, dispatchersType>::get_position_async(
+    long long unsigned int payload_size, std::function<void(char*)> ready,
+    int pause_sending_turns, bool cooked_send) {
+    unique_lock<mutex> lock(position_mtx);
+    if(!position_possible(payload_size)) {
+        lock.unlock();
+        ready(nullptr);
+        return;
+    }
+    position_requests.push_back(std::make_shared<position_request>(position_request{
+        payload_size, pause_sending_turns, cooked_send, std::move(ready)}));
+    has_position_requests = true;
+    lock.unlock();
+    serve_position_requests();
+}
+
+template <unsigned int N, typename dispatchersType>
+void DerechoGroup<N, dispatchersType>::serve_position_requests() {
+    if(!has_position_requests) {
+        return;
+    }
+    unique_lock<mutex> lock(position_mtx);
+    while(!position_granted && !position_requests.empty()) {
+        std::shared_ptr<position_request> request = position_requests.front();
+        char* buf = try_get_position(request->payload_size, request->pause_sending_turns,
+                                     request->cooked_send);
+        if(!buf && !thread_shutdown) {
+            // Still no room; the next delivery will try again
+            break;
+        }
+        position_requests.pop_front();
+        has_position_requests = !position_requests.empty();
+        position_granted = buf != nullptr;
+        // ready may send right away, which comes back here
+        lock.unlock();
+        request->ready(buf);
+        lock.lock();
+    }
+}
+
+template <unsigned int N, typename dispatchersType>
+void DerechoGroup<N, dispatchersType>::position_sent() {
+    {
+        lock_guard<mutex> lock(position_mtx);
+        position_granted = false;
+    }
+    serve_position_requests();
+}
+
+template <unsigned int N, typename dispatchersType>
+char* DerechoGroup<N, dispatchersType>::try_get_position(
     long long unsigned int payload_size,
     int pause_sending_turns, bool cooked_send) {
     // if rdmc groups were not created because of failures, return NULL
     if(!rdmc_groups_created) {
         return NULL;
     }
+    if(null_send_interval.count() > 0) {
+        last_position_request = std::chrono::steady_clock::now();
+    }
     long long unsigned int msg_size = payload_size + sizeof(header);
     // payload_size is 0 when max_msg_size is desired, useful for ordered send/query
     if(!payload_size) {
@@ -718,30 +1344,39 @@ char* DerechoGroup<N, dispatchersType>::get_position(
              << max_msg_size << endl;
         return nullptr;
     }
+    if(batching) {
+        // Messages given the maximum size (payload_size == 0) are never batched
+        bool batchable = payload_size && sizeof(header) + sizeof(batch_entry_header) + msg_size <= max_msg_size;
+        return get_batched_position(msg_size, batchable, pause_sending_turns, cooked_send);
+    }
     for(int i = 0; i < num_members; ++i) {
         if((*sst)[i].delivered_num <
-           (future_message_index - window_size) * num_members + member_index) {
+           (future_message_index - current_window()) * num_members + member_index) {
+            return nullptr;
+        }
+        // Each message waiting to be persisted holds a buffer, so the
+        // persistence window bounds how many of them this sender can use
+        if(file_writer && (*sst)[i].persisted_num <
+           (future_message_index - persistence_window) * num_members + member_index) {
             return nullptr;
         }
     }
 
-    unique_lock<mutex> lock(msg_state_mtx);
     if(thread_shutdown) return nullptr;
-    if(free_message_buffers.empty()) return nullptr;
 
     // Create new Message
     Message msg;
+    if(!message_buffers->acquire(msg_size, msg.message_buffer)) return nullptr;
     msg.sender_rank = member_index;
     msg.index = future_message_index;
     msg.size = msg_size;
-    msg.message_buffer = std::move(free_message_buffers.back());
-    free_message_buffers.pop_back();
 
     // Fill header
     char* buf = msg.message_buffer.buffer.get();
     ((header*)buf)->header_size = sizeof(header);
     ((header*)buf)->pause_sending_turns = pause_sending_turns;
     ((header*)buf)->cooked_send = cooked_send;
+    ((header*)buf)->num_batched = 0;
 
     next_send = std::move(msg);
     future_message_index += pause_sending_turns + 1;
@@ -749,6 +1384,89 @@ char* DerechoGroup<N, dispatchersType>::get_position(
     return buf + sizeof(header);
 }
 
+/**
+ * get_position for batching mode. Batchable messages are written into the
+ * open batch, starting a new one if there is none or it is full; any other
+ * message closes the open batch and is sent on its own. Either way, a new send
+ * can only be started once the send started current_window() sends ago has been
+ * delivered everywhere.
+ */
+template <unsigned int N, typename dispatchersType>
+char* DerechoGroup<N, dispatchersType>::get_batched_position(
+    long long unsigned int msg_size, bool batchable,
+    int pause_sending_turns, bool cooked_send) {
+    unique_lock<mutex> batch_lock(batch_mtx);
+    if(thread_shutdown) return nullptr;
+    assert(!batch_reserved);
+    const size_t entry_size = sizeof(batch_entry_header) + msg_size;
+    if(open_batch && (!batchable || open_batch_size + entry_size > max_msg_size)) {
+        pending_sends.push(close_batch());
+        batch_lock.unlock();
+        wake_sender();
+        batch_lock.lock();
+    }
+
+    if(!open_batch) {
+        const unsigned int window = current_window();
+        if(sends_started >= window) {
+            // The send started window sends ago ended just before the one
+            // started after it
+            long long int next_start = window == 1
+                                           ? future_message_index
+                                           : send_start_indices[(sends_started - window + 1) % window_size];
+            for(int i = 0; i < num_members; ++i) {
+                if((*sst)[i].delivered_num < (next_start - 1) * num_members + member_index) {
+                    return nullptr;
+                }
+            }
+        }
+        if(file_writer) {
+            for(int i = 0; i < num_members; ++i) {
+                if((*sst)[i].persisted_num < (future_message_index - persistence_window) * num_members + member_index) {
+                    return nullptr;
+                }
+            }
+        }
+        // A batch can grow to max_msg_size, so it needs the largest buffer
+        Message msg;
+        if(!message_buffers->acquire(batchable ? max_msg_size : msg_size, msg.message_buffer)) return nullptr;
+        msg.sender_rank = member_index;
+        msg.index = future_message_index;
+        msg.size = msg_size;
+        send_start_indices[sends_started % window_size] = future_message_index;
+        sends_started++;
+
+        char* buf = msg.message_buffer.buffer.get();
+        ((header*)buf)->header_size = sizeof(header);
+        ((header*)buf)->pause_sending_turns = pause_sending_turns;
+        ((header*)buf)->cooked_send = cooked_send;
+        ((header*)buf)->num_batched = 0;
+        if(!batchable) {
+            next_send = std::move(msg);
+            future_message_index += pause_sending_turns + 1;
+            return buf + sizeof(header);
+        }
+        open_batch = std::move(msg);
+        open_batch_size = sizeof(header);
+        open_batch_count = 0;
+        open_batch_turns = 0;
+    }
+
+    char* entry = open_batch->message_buffer.buffer.get() + open_batch_size;
+    ((batch_entry_header*)entry)->size = msg_size;
+    char* buf = entry + sizeof(batch_entry_header);
+    ((header*)buf)->header_size = sizeof(header);
+    ((header*)buf)->pause_sending_turns = pause_sending_turns;
+    ((header*)buf)->cooked_send = cooked_send;
+    ((header*)buf)->num_batched = 0;
+    batch_reserved = true;
+    reserved_size = entry_size;
+    reserved_turns = pause_sending_turns + 1;
+    future_message_index += pause_sending_turns + 1;
+
+    return buf + sizeof(header);
+}
+
 template <unsigned int N, typename dispatchersType>
 template <typename IdClass, unsigned long long tag, typename... Args>
 auto DerechoGroup<N, dispatchersType>::derechoCallerSend(
@@ -773,8 +1491,9 @@ auto DerechoGroup<N, dispatchersType>::derechoCallerSend(
             }
         },
         std::forward<Args>(args)...);
-    while(!send()) {
-    }
+    // The caller sends the message with send() once this returns (through
+    // ManagedGroup::send, which waits for the next view if this one has been
+    // wedged meanwhile)
     auto P = createPending(return_pair.pending);
 
     std::lock_guard<std::mutex> lock(pending_results_mutex);
@@ -823,19 +1542,23 @@ auto DerechoGroup<N, dispatchersType>::tcpSend(node_id_t dest_node,
     assert(dest_node != members[member_index]);
     // use dest_node
 
+    // Each call serializes into its own buffer, so concurrent p2p sends
+    // don't race on a shared one
     size_t size;
-    auto max_payload_size = max_msg_size - sizeof(header);
+    auto max_payload_size = reply_buffers->get_buffer_size();
+    std::unique_ptr<char[]> send_buffer = reply_buffers->acquire();
     auto return_pair = dispatchers.template Send<IdClass, tag>(
-        [this, &max_payload_size, &size](size_t _size) -> char* {
+        [&send_buffer, &max_payload_size, &size](size_t _size) -> char* {
             size = _size;
             if(size <= max_payload_size) {
-                return p2pBuffer.get();
+                return send_buffer.get();
             } else {
                 return nullptr;
             }
         },
         std::forward<Args>(args)...);
-    connections.write(dest_node, p2pBuffer.get(), size);
+    connections.write(dest_node, send_buffer.get(), size);
+    reply_buffers->release(std::move(send_buffer));
     auto P = createPending(return_pair.pending);
     P->fulfill_map({dest_node});
 
@@ -868,36 +1591,67 @@ void DerechoGroup<N, dispatchersType>::rpc_process_loop() {
     using namespace ::rpc::remote_invocation_utilities;
     const auto header_size = header_space();
     auto max_payload_size = max_msg_size - sizeof(header);
-    std::unique_ptr<char[]> rpcBuffer =
-        std::unique_ptr<char[]>(new char[max_payload_size]);
+    // Bytes received from one connection that haven't been handled yet. A
+    // message is handled once all of it has arrived.
+    struct receive_buffer {
+        std::unique_ptr<char[]> data;
+        size_t filled = 0;
+    };
+    std::map<node_id_t, receive_buffer> receive_buffers;
+    std::vector<node_id_t> ready;
     while(!thread_shutdown) {
-        auto other_id = connections.probe_all();
-        if(other_id < 0) {
-            continue;
-        }
-        connections.read(other_id, rpcBuffer.get(), header_size);
-        std::size_t payload_size;
-        Opcode indx;
-        Node_id received_from;
-        retrieve_header(nullptr, rpcBuffer.get(), payload_size,
-                        indx, received_from);
-        connections.read(other_id, rpcBuffer.get() + header_size,
-                             payload_size);
-        size_t reply_size = 0;
-        dispatchers.handle_receive(
-            indx, received_from, rpcBuffer.get() + header_size, payload_size,
-            [&rpcBuffer, &max_payload_size,
-             &reply_size](size_t _size) -> char* {
-                reply_size = _size;
-                if(reply_size <= max_payload_size) {
-                    return rpcBuffer.get();
-                } else {
-                    return nullptr;
+        // Sleep until a connection has data (or wedge() interrupts us)
+        ready.clear();
+        connections.wait_for_data(ready, -1);
+        for(auto other_id : ready) {
+            receive_buffer& rb = receive_buffers[other_id];
+            if(!rb.data) {
+                rb.data = std::unique_ptr<char[]>(new char[max_payload_size]);
+            }
+            auto bytes_read = connections.read_available(
+                other_id, rb.data.get() + rb.filled, max_payload_size - rb.filled);
+            if(bytes_read < 0) {
+                receive_buffers.erase(other_id);
+                continue;
+            }
+            rb.filled += bytes_read;
+
+            size_t consumed = 0;
+            while(rb.filled - consumed >= header_size) {
+                char* message = rb.data.get() + consumed;
+                std::size_t payload_size;
+                Opcode indx;
+                Node_id received_from;
+                retrieve_header(nullptr, message, payload_size,
+                                indx, received_from);
+                assert(header_size + payload_size <= max_payload_size);
+                if(rb.filled - consumed < header_size + payload_size) {
+                    break;
+                }
+                size_t reply_size = 0;
+                std::unique_ptr<char[]> reply_buffer = reply_buffers->acquire();
+                dispatchers.handle_receive(
+                    indx, received_from, message + header_size, payload_size,
+                    [&reply_buffer, &max_payload_size,
+                     &reply_size](size_t _size) -> char* {
+                        reply_size = _size;
+                        if(reply_size <= max_payload_size) {
+                            return reply_buffer.get();
+                        } else {
+                            return nullptr;
+                        }
+                    });
+                if(reply_size > 0) {
+                    connections.write(received_from.id, reply_buffer.get(),
+                                      reply_size);
                 }
-            });
-        if(reply_size > 0) {
-            connections.write(received_from.id, rpcBuffer.get(),
-                              reply_size);
+                reply_buffers->release(std::move(reply_buffer));
+                consumed += header_size + payload_size;
+            }
+            if(consumed > 0) {
+                std::memmove(rb.data.get(), rb.data.get() + consumed, rb.filled - consumed);
+                rb.filled -= consumed;
+            }
         }
     }
 }
@@ -913,6 +1667,35 @@ void DerechoGroup<N, dispatchersType>::set_exceptions_for_removed_nodes(
     }
 }
 
+template <unsigned int N, typename dispatchersType>
+uint64_t DerechoGroup<N, dispatchersType>::truncate_log(long long int checkpoint_seq_num) {
+    if(!file_writer) {
+        return 0;
+    }
+    // The log is ordered by (vid, index); only the rounds of indices that
+    // the checkpoint covers for every sender can be dropped
+    uint64_t complete_rounds = (checkpoint_seq_num + 1) / num_members;
+    return file_writer->truncate_before((*sst)[member_index].vid, complete_rounds);
+}
+
+template <unsigned int N, typename dispatchersType>
+send_stall_stats DerechoGroup<N, dispatchersType>::get_send_stall_stats() const {
+    send_stall_stats stats;
+    stats.delivery = std::chrono::nanoseconds(delivery_stall_ns.load());
+    stats.persistence = std::chrono::nanoseconds(persistence_stall_ns.load());
+    return stats;
+}
+
+template <unsigned int N, typename dispatchersType>
+window_stats DerechoGroup<N, dispatchersType>::get_window_stats() const {
+    if(send_window) {
+        return send_window->get_stats();
+    }
+    window_stats stats;
+    stats.window = window_size;
+    return stats;
+}
+
 template <unsigned int N, typename dispatchersType>
 void DerechoGroup<N, dispatchersType>::debug_print() {
     cout << "In DerechoGroup SST has " << sst->get_num_rows()
@@ -2,10 +2,12 @@
 #define DERECHO_ROW_H_
 
 #include <atomic>
+#include <cstddef>
 #include <cstring>
 #include <mutex>
 #include <string>
 #include <sstream>
+#include <type_traits>
 
 namespace derecho {
 
@@ -14,33 +16,66 @@ using node_id_t = uint32_t;
 
 using cstring = char[50];
 
+/** The cache line size assumed when laying out SST rows. */
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
 /**
- * The GMS and derecho_group will share the same SST for efficiency
+ * The GMS and derecho_group will share the same SST for efficiency.
+ *
+ * The per-message counters come first, grouped by the thread that writes
+ * them in the local row, and each group starts on its own cache line so
+ * that those threads don't falsely share lines with each other or with the
+ * predicate thread reading them. The GMS fields, which only change on view
+ * changes, follow on separate lines, so the counters can be put to the other
+ * members without shipping any GMS bytes. See row_layout_is_valid for the
+ * properties this layout must keep.
  */
 template <unsigned int N>
 struct DerechoRow {
     // derecho_group members. Copy-pasted from derecho_group.h's
     // MessageTrackingRow
+
+    // Written by the receive path
     /** This variable is the highest sequence number that has been received
      * in-order by this node; if a node updates seq_num, it has received all
      * messages up to seq_num in the global round-robin order. */
-    long long int seq_num;
+    alignas(CACHE_LINE_SIZE) long long int seq_num;
+    /** Local count of number of received messages by sender.  For each
+     * sender k, nReceived[k] is the number received (a.k.a. "locally stable").
+     */
+    long long int nReceived[N];
+
+    // Written by the predicate thread
     /** This represents the highest sequence number that has been received
      * by every node, as observed by this node. If a node updates stable_num,
      * then it believes that all messages up to stable_num in the global
      * round-robin order have been received by every node. */
-    long long int stable_num;
+    alignas(CACHE_LINE_SIZE) long long int stable_num;
     /** This represents the highest sequence number that has been delivered
      * at this node. Messages are only delievered once stable, so it must be
      * at least stable_num. */
     long long int delivered_num;
+
+    // Written by the persistence callback
     /** This represents the highest sequence number that has been persisted
      * to disk at this node, if persistence is enabled. Messages are only
      * persisted to disk once delivered to the application. */
-    long long int persisted_num;
+    alignas(CACHE_LINE_SIZE) long long int persisted_num;
+
+    // Written by the timeout thread, only while this member is idle, and
+    // read by every member's predicate thread
+    /** The first and last of a range of this member's message indices that
+     * it skipped without sending anything (null messages), because it was
+     * idle while other members sent and would otherwise hold back their
+     * delivery. Once a member has received every message from this one
+     * before null_range_start, it counts the range as received too. -1 if
+     * there has been none in this view. */
+    alignas(CACHE_LINE_SIZE) long long int null_range_start;
+    long long int null_range_end;
 
+    // GMS members
     /** View ID associated with this SST */
-    int vid;
+    alignas(CACHE_LINE_SIZE) int vid;
     /** Array of same length as View::members, where each bool represents
      * whether the corresponding member is suspected to have failed */
     bool suspected[N];
@@ -60,10 +95,6 @@ struct DerechoRow {
     /** How many proposed changes have been seen. Incremented by a member
      * to acknowledge that it has seen a proposed change.*/
     int nAcked;
-    /** Local count of number of received messages by sender.  For each
-     * sender k, nReceived[k] is the number received (a.k.a. "locally stable").
-     */
-    long long int nReceived[N];
     /** Set after calling rdmc::wedged(), reports that this member is wedged.
      * Must be after nReceived!*/
     bool wedged;
@@ -73,6 +104,41 @@ struct DerechoRow {
     bool globalMinReady;
 };
 
+/** The size of the per-message counters at the start of a DerechoRow<N>;
+ * putting this many bytes from offset 0 ships all of them and no GMS field. */
+template <unsigned int N>
+constexpr std::size_t row_counters_size() {
+    return offsetof(DerechoRow<N>, vid);
+}
+
+/**
+ * Checks the layout of DerechoRow<N> at compile time: each group of
+ * counters starts a cache line and ends before the next group, the counters
+ * precede the GMS fields, and fields that a whole-row put relies on being
+ * written after others still come after them.
+ */
+template <unsigned int N>
+constexpr bool row_layout_is_valid() {
+    using Row = DerechoRow<N>;
+    return std::is_standard_layout<Row>::value
+           && offsetof(Row, seq_num) % CACHE_LINE_SIZE == 0
+           && offsetof(Row, stable_num) % CACHE_LINE_SIZE == 0
+           && offsetof(Row, persisted_num) % CACHE_LINE_SIZE == 0
+           && offsetof(Row, null_range_start) % CACHE_LINE_SIZE == 0
+           && offsetof(Row, vid) % CACHE_LINE_SIZE == 0
+           && offsetof(Row, nReceived) + sizeof(Row::nReceived) <= offsetof(Row, stable_num)
+           && offsetof(Row, delivered_num) + sizeof(long long int) <= offsetof(Row, persisted_num)
+           && offsetof(Row, persisted_num) + sizeof(long long int) <= offsetof(Row, null_range_start)
+           && offsetof(Row, null_range_end) + sizeof(long long int) <= row_counters_size<N>()
+           && offsetof(Row, wedged) > offsetof(Row, nReceived)
+           && offsetof(Row, globalMinReady) > offsetof(Row, globalMin)
+           && sizeof(Row) % CACHE_LINE_SIZE == 0;
+}
+
+static_assert(row_layout_is_valid<1>(), "DerechoRow layout is broken");
+static_assert(row_layout_is_valid<7>(), "DerechoRow layout is broken");
+static_assert(row_layout_is_valid<16>(), "DerechoRow layout is broken");
+
 template <unsigned int N>
 using GMSTableRow = DerechoRow<N>;
 
@@ -248,6 +314,72 @@ std::string to_string(volatile const DerechoRow<N>& row) {
     return s.str();
 }
 
+/** A range of bytes of a row, as passed to SST::put. */
+struct row_range {
+    std::size_t offset;
+    std::size_t size;
+};
+
+/** The ranges of a row that a group actually uses, in order. */
+struct row_ranges {
+    /** One per field or per-member array of DerechoRow, at most. */
+    row_range ranges[10];
+    int count = 0;
+
+    const row_range* begin() const { return ranges; }
+    const row_range* end() const { return ranges + count; }
+    /** Adds size bytes at offset, merging them into the last range if the
+     * gap between them is less than a cache line: shipping a few unused
+     * bytes is cheaper than another put. */
+    void add(std::size_t offset, std::size_t size) {
+        if(count > 0 && offset < ranges[count - 1].offset + ranges[count - 1].size + CACHE_LINE_SIZE) {
+            ranges[count - 1].size = offset + size - ranges[count - 1].offset;
+        } else {
+            ranges[count++] = {offset, size};
+        }
+    }
+};
+
+/**
+ * The parts of a Row (a DerechoRow<N>) that a group of num_members members
+ * uses: every field, but only the first num_members entries of the arrays
+ * indexed by member rank. changes is a ring of proposals indexed modulo N,
+ * so all of it is used.
+ */
+template <typename Row>
+row_ranges used_ranges(unsigned int num_members) {
+    row_ranges used;
+    used.add(offsetof(Row, seq_num), sizeof(long long int));
+    used.add(offsetof(Row, nReceived), num_members * sizeof(long long int));
+    used.add(offsetof(Row, stable_num), sizeof(long long int));
+    used.add(offsetof(Row, delivered_num), sizeof(long long int));
+    used.add(offsetof(Row, persisted_num), sizeof(long long int));
+    used.add(offsetof(Row, null_range_start), 2 * sizeof(long long int));
+    used.add(offsetof(Row, vid), sizeof(int));
+    used.add(offsetof(Row, suspected), num_members * sizeof(bool));
+    used.add(offsetof(Row, changes), sizeof(Row::changes));
+    used.add(offsetof(Row, joiner_ip), offsetof(Row, wedged) + sizeof(bool) - offsetof(Row, joiner_ip));
+    used.add(offsetof(Row, globalMin), num_members * sizeof(int));
+    used.add(offsetof(Row, globalMinReady), sizeof(bool));
+    return used;
+}
+
+/**
+ * Puts the local row of sst to the other members, like sst.put(), but
+ * leaves out the entries of the per-member arrays beyond the number of
+ * members (rows) in the SST, so the bytes put scale with the size of the
+ * group rather than with MAX_MEMBERS. The ranges are put in row order, so
+ * fields that must reach the other members after others (wedged after
+ * nReceived, globalMinReady after globalMin) still do.
+ */
+template <typename SSTType>
+void put_used(SSTType& sst) {
+    using Row = typename std::remove_cv<typename std::remove_reference<decltype(sst[0])>::type>::type;
+    for(const row_range& range : used_ranges<Row>(sst.get_num_rows())) {
+        sst.put(range.offset, range.size);
+    }
+}
+
 void set(volatile cstring& element, const std::string& value);
 
 void increment(volatile int& member);
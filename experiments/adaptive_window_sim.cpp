@@ -0,0 +1,66 @@
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <utility>
+
+#include "../adaptive_window.h"
+
+using namespace std;
+using namespace std::chrono;
+using derecho::adaptive_window;
+using derecho::window_stats;
+
+/*
+ * Drives an adaptive_window against a simulated link that sends one message
+ * every 200us and delivers it 1ms after it leaves, so that it takes about 6
+ * messages in flight to keep the link busy (its bandwidth-delay product).
+ * The simulation runs in real time, since adaptive_window reads the clock
+ * itself. For a few initial windows, prints where the window settled, the
+ * latencies it measured and the throughput against the link's rate.
+ */
+
+const auto service_time = microseconds(200);
+const auto propagation_delay = microseconds(1000);
+const auto run_time = seconds(2);
+
+void simulate(unsigned int max_window, unsigned int initial_window) {
+    adaptive_window window(max_window, initial_window);
+    // Messages on the link, with the time each will be delivered
+    deque<pair<long long int, steady_clock::time_point>> in_flight;
+    auto link_free = steady_clock::now();
+    long long int next_index = 0;
+    long long int num_delivered = 0;
+    auto end = steady_clock::now() + run_time;
+    while(steady_clock::now() < end) {
+        auto now = steady_clock::now();
+        while(next_index - num_delivered < window.get()) {
+            window.sent(next_index);
+            link_free = max(link_free, now) + service_time;
+            in_flight.push_back({next_index, link_free + propagation_delay});
+            next_index++;
+        }
+        while(!in_flight.empty() && in_flight.front().second <= steady_clock::now()) {
+            window.delivered(in_flight.front().first);
+            num_delivered = in_flight.front().first + 1;
+            in_flight.pop_front();
+        }
+    }
+    window_stats stats = window.get_stats();
+    long long int link_rate = run_time / service_time;
+    cout << setw(10) << initial_window << setw(10) << stats.window
+         << setw(16) << duration_cast<microseconds>(stats.base_latency).count()
+         << setw(16) << duration_cast<microseconds>(stats.latency).count()
+         << setw(14) << fixed << setprecision(1) << 100.0 * num_delivered / link_rate << "%" << endl;
+}
+
+int main() {
+    const unsigned int max_window = 32;
+    cout << "Link: " << service_time.count() << "us per message, "
+         << propagation_delay.count() << "us propagation; max_window " << max_window << endl;
+    cout << setw(10) << "initial" << setw(10) << "settled" << setw(16) << "base lat (us)"
+         << setw(16) << "latency (us)" << setw(15) << "of link rate" << endl;
+    for(unsigned int initial_window : {1u, 3u, 8u, 32u}) {
+        simulate(max_window, initial_window);
+    }
+}
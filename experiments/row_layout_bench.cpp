@@ -0,0 +1,122 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#include "../derecho_row.h"
+
+using namespace std;
+
+/*
+ * Runs the DerechoGroup predicate loop against a table of SST rows while
+ * other threads update the local row the way the receive path and the
+ * persistence callback do, and reports how many predicate evaluations and
+ * row updates each thread manages. The current DerechoRow, whose counter
+ * groups are on separate cache lines, is compared to the previous layout,
+ * in which the counters shared lines with each other and the GMS fields.
+ */
+
+/** DerechoRow as it was before its fields were grouped by cache line. */
+template <unsigned int N>
+struct LegacyRow {
+    long long int seq_num;
+    long long int stable_num;
+    long long int delivered_num;
+    long long int persisted_num;
+    int vid;
+    bool suspected[N];
+    derecho::node_id_t changes[N];
+    derecho::cstring joiner_ip;
+    int nChanges;
+    int nCommitted;
+    int nAcked;
+    long long int nReceived[N];
+    bool wedged;
+    int globalMin[N];
+    bool globalMinReady;
+};
+
+const unsigned int num_members = 16;
+const auto run_time = chrono::seconds(2);
+
+struct results {
+    uint64_t evaluations;
+    uint64_t receives;
+    uint64_t persists;
+};
+
+template <typename Row>
+results run() {
+    void* memory;
+    if(posix_memalign(&memory, derecho::CACHE_LINE_SIZE, num_members * sizeof(Row)) != 0) {
+        throw bad_alloc();
+    }
+    volatile Row* rows = new(memory) Row[num_members]();
+    volatile Row& local = rows[0];
+    atomic<bool> done(false);
+    results r{};
+
+    // The receive path: a message from each sender in turn
+    thread receiver([&]() {
+        uint64_t count = 0;
+        while(!done) {
+            unsigned int sender = count % num_members;
+            local.nReceived[sender] = local.nReceived[sender] + 1;
+            local.seq_num = count;
+            count++;
+        }
+        r.receives = count;
+    });
+    // The persistence callback, once per message
+    thread persister([&]() {
+        uint64_t count = 0;
+        while(!done) {
+            local.persisted_num = count++;
+        }
+        r.persists = count;
+    });
+
+    // The stability and delivery predicates, over every row
+    auto end = chrono::steady_clock::now() + run_time;
+    uint64_t evaluations = 0;
+    while((evaluations & 1023) || chrono::steady_clock::now() < end) {
+        long long int min_seq_num = rows[0].seq_num;
+        long long int min_persisted_num = rows[0].persisted_num;
+        for(unsigned int i = 1; i < num_members; ++i) {
+            min_seq_num = min(min_seq_num, (long long int)rows[i].seq_num);
+            min_persisted_num = min(min_persisted_num, (long long int)rows[i].persisted_num);
+        }
+        local.stable_num = min_seq_num;
+        local.delivered_num = min(min_seq_num, min_persisted_num + 1);
+        evaluations++;
+    }
+    done = true;
+    receiver.join();
+    persister.join();
+    r.evaluations = evaluations;
+    free(memory);
+    return r;
+}
+
+void print(const string& name, size_t row_size, const results& r) {
+    double seconds = chrono::duration<double>(run_time).count();
+    cout << setw(10) << name << setw(10) << row_size
+         << setw(20) << fixed << setprecision(1) << r.evaluations / seconds / 1e6
+         << setw(16) << r.receives / seconds / 1e6
+         << setw(16) << r.persists / seconds / 1e6 << endl;
+}
+
+int main() {
+    if(thread::hardware_concurrency() < 3) {
+        cout << "WARNING: the three threads share fewer than three CPUs, so "
+             << "false sharing between them won't show up" << endl;
+    }
+    cout << "Millions per second, with " << num_members << " rows" << endl;
+    cout << setw(10) << "layout" << setw(10) << "row size" << setw(20) << "predicate evals"
+         << setw(16) << "receives" << setw(16) << "persists" << endl;
+    print("legacy", sizeof(LegacyRow<num_members>), run<LegacyRow<num_members>>());
+    print("current", sizeof(derecho::DerechoRow<num_members>), run<derecho::DerechoRow<num_members>>());
+}
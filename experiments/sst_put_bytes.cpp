@@ -0,0 +1,92 @@
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "../derecho_row.h"
+
+using namespace std;
+
+/*
+ * A model, not a measurement: nothing is sent. Each message delivered by a
+ * DerechoGroup updates five counters in the local SST row: nReceived[sender]
+ * and seq_num when it is received, stable_num when it becomes stable,
+ * delivered_num when it is delivered and persisted_num when it is persisted.
+ * This replays that sequence of updates against a stand-in for the SST that
+ * records the ranges each put would post, once putting the whole DerechoRow
+ * for every update and once putting just the updated counter, and prints how
+ * many payload bytes each node would post to the others per message for
+ * several values of MAX_MEMBERS. Both schemes see exactly the same updates.
+ * The counts are of RDMA write payloads, using the real DerechoRow layout;
+ * they leave out the per-write headers and completions on the wire, which
+ * only widen the gap since both schemes make the same number of puts.
+ */
+
+/** Stands in for the SST: counts the bytes each put would post to every
+ * other member of a full group. */
+template <unsigned int N>
+struct recording_sst {
+    size_t bytes = 0;
+    size_t puts = 0;
+
+    void put() { put(0, sizeof(derecho::DerechoRow<N>)); }
+    void put(size_t offset, size_t size) {
+        if(offset + size > sizeof(derecho::DerechoRow<N>)) {
+            throw std::out_of_range("put past the end of the row");
+        }
+        bytes += size * (N - 1);
+        puts++;
+    }
+};
+
+/** One counter update: where in the row it is. */
+struct update {
+    size_t offset;
+    size_t size;
+};
+
+/** The updates the receive, stability, delivery and persistence paths make
+ * for a message from sender. */
+template <unsigned int N>
+vector<update> updates_for_message(unsigned int sender) {
+    using Row = derecho::DerechoRow<N>;
+    return {{offsetof(Row, nReceived) + sender * sizeof(long long int), sizeof(long long int)},
+            {offsetof(Row, seq_num), sizeof(long long int)},
+            {offsetof(Row, stable_num), sizeof(long long int)},
+            {offsetof(Row, delivered_num), sizeof(long long int)},
+            {offsetof(Row, persisted_num), sizeof(long long int)}};
+}
+
+template <unsigned int N>
+void print_row() {
+    const unsigned int num_messages = 10 * N;
+    recording_sst<N> full_row;
+    recording_sst<N> fields;
+    for(unsigned int m = 0; m < num_messages; ++m) {
+        for(const update& u : updates_for_message<N>(m % N)) {
+            full_row.put();
+            fields.put(u.offset, u.size);
+        }
+    }
+    size_t full = full_row.bytes / num_messages;
+    size_t partial = fields.bytes / num_messages;
+    cout << setw(12) << N << setw(12) << sizeof(derecho::DerechoRow<N>)
+         << setw(16) << full_row.puts / num_messages
+         << setw(20) << full << setw(20) << partial
+         << setw(10) << fixed << setprecision(1) << (double)full / partial << "x" << endl;
+}
+
+template <unsigned int... Ns>
+void print_rows() {
+    int dummy[] = {(print_row<Ns>(), 0)...};
+    (void)dummy;
+}
+
+int main() {
+    cout << "Modelled bytes put per message by one node to a full group of MAX_MEMBERS" << endl;
+    cout << setw(12) << "MAX_MEMBERS" << setw(12) << "row size" << setw(16) << "puts/message"
+         << setw(20) << "full-row puts" << setw(20) << "field puts"
+         << setw(11) << "ratio" << endl;
+    print_rows<2, 4, 8, 16, 32, 64, 128, 256>();
+}
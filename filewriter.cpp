@@ -1,28 +1,365 @@
-
 #include "filewriter.h"
-#include "mutils-serialization/SerializationSupport.hpp"
+#include "log_reader.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <climits>
 #include <cstring>
-#include <thread>
+#include <fcntl.h>
+#include <functional>
 #include <iostream>
-#include <fstream>
+#include <sys/uio.h>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
 #include <utility>
-#include <functional>
+
+#ifdef DERECHO_HAVE_LIBURING
+#include <liburing.h>
+#endif
 
 using std::mutex;
 using std::unique_lock;
-using std::ofstream;
 
 namespace derecho {
 
 using namespace persistence;
 
-const uint8_t MAGIC_NUMBER[8] = {'D', 'E', 'R', 'E', 'C', 'H', 'O', 29};
+namespace {
+
+/**
+ * Writes all of iov to fd starting at offset, splitting it into chunks of at
+ * most IOV_MAX and continuing after short writes.
+ */
+bool pwritev_all(int fd, std::vector<iovec> iov, uint64_t offset) {
+    size_t first = 0;
+    while(first < iov.size()) {
+        int count = std::min<size_t>(iov.size() - first, IOV_MAX);
+        ssize_t written = pwritev(fd, &iov[first], count, offset);
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        offset += written;
+        // Skip the iovecs that were written completely, and trim the one
+        // that was written partially
+        while(written > 0) {
+            if((size_t)written >= iov[first].iov_len) {
+                written -= iov[first].iov_len;
+                first++;
+            } else {
+                iov[first].iov_base = (char*)iov[first].iov_base + written;
+                iov[first].iov_len -= written;
+                written = 0;
+            }
+        }
+    }
+    return true;
+}
+
+bool sync_file(int fd, durability_level durability) {
+    switch(durability) {
+        case DURABILITY_DATA_SYNC:
+            return fdatasync(fd) == 0;
+        case DURABILITY_FULL_SYNC:
+            return fsync(fd) == 0;
+        case DURABILITY_OS_BUFFERED:
+        default:
+            return true;
+    }
+}
+
+/**
+ * Writes a batch with one pwritev per file. The data is synced before the
+ * metadata is written, so a metadata entry never reaches the disk before
+ * the data it describes.
+ */
+bool pwritev_batch(int data_fd, const std::vector<iovec>& data_iov, uint64_t data_offset,
+                   int metadata_fd, const iovec& metadata_iov, uint64_t metadata_offset,
+                   durability_level durability) {
+    return pwritev_all(data_fd, data_iov, data_offset)
+           && sync_file(data_fd, durability)
+           && pwritev_all(metadata_fd, {metadata_iov}, metadata_offset)
+           && sync_file(metadata_fd, durability);
+}
+
+index_entry make_index_entry(const message_metadata& record, uint64_t record_number) {
+    index_entry entry;
+    entry.view_id = record.view_id;
+    entry.padding0 = 0;
+    entry.index = record.index;
+    entry.record_number = record_number;
+    return entry;
+}
+
+/**
+ * Writes new_entries after the first num_entries entries of the index file,
+ * followed by a trailer describing a log of num_records records. The index
+ * is only a hint that readers validate against the metadata file, so it is
+ * never synced.
+ */
+bool write_index(int fd, const std::vector<index_entry>& new_entries, uint64_t num_entries,
+                 const message_metadata& last_record, uint64_t num_records) {
+    index_trailer trailer;
+    trailer.last_record = last_record;
+    trailer.num_records = num_records;
+    trailer.num_entries = num_entries + new_entries.size();
+    memcpy(trailer.magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER));
+    std::vector<iovec> iov;
+    if(!new_entries.empty()) {
+        iov.push_back({(void*)new_entries.data(), new_entries.size() * sizeof(index_entry)});
+    }
+    iov.push_back({&trailer, sizeof(trailer)});
+    return pwritev_all(fd, iov, num_entries * sizeof(index_entry));
+}
+
+const uint64_t page_size = sysconf(_SC_PAGESIZE);
+
+uint64_t round_up_to_page(uint64_t n) {
+    return (n + page_size - 1) / page_size * page_size;
+}
+
+/** The files and write positions of the segment being appended to. */
+struct active_segment {
+    /** Whether the data file was opened with O_DIRECT. */
+    bool direct = false;
+    int data_fd = -1;
+    int metadata_fd = -1;
+    int index_fd = -1;
+    uint64_t data_offset = 0;
+    uint64_t metadata_offset = 0;
+    uint64_t num_records = 0;
+    uint64_t num_index_entries = 0;
+    message_metadata first_record{};
+    message_metadata last_record{};
+    std::chrono::steady_clock::time_point opened;
+};
+
+void close_segment(active_segment& segment) {
+    for(int fd : {segment.data_fd, segment.metadata_fd, segment.index_fd}) {
+        if(fd >= 0) {
+            close(fd);
+        }
+    }
+    segment = active_segment();
+}
+
+/** Opens (or creates) the log files called filename, to append to them. */
+bool open_segment(const std::string& filename, bool direct_io, active_segment& segment) {
+    if(direct_io) {
+        segment.data_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | O_DIRECT, 0644);
+        segment.direct = segment.data_fd >= 0;
+        if(!segment.direct) {
+            // e.g. tmpfs doesn't support O_DIRECT
+            std::cerr << "WARNING: FileWriter could not open " << filename << " with O_DIRECT: "
+                      << strerror(errno) << "; using buffered writes" << std::endl;
+        }
+    }
+    if(!segment.direct) {
+        segment.data_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    }
+    segment.metadata_fd = open((filename + METADATA_EXTENSION).c_str(),
+                               O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    segment.index_fd = open((filename + INDEX_EXTENSION).c_str(),
+                            O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if(segment.data_fd < 0 || segment.metadata_fd < 0 || segment.index_fd < 0) {
+        std::cerr << "ERROR: FileWriter could not open " << filename << ": "
+                  << strerror(errno) << std::endl;
+        close_segment(segment);
+        return false;
+    }
+    segment.opened = std::chrono::steady_clock::now();
+
+    // Append to whatever is already in the files
+    segment.data_offset = lseek(segment.data_fd, 0, SEEK_END);
+    bool new_file = lseek(segment.metadata_fd, 0, SEEK_END) < (off_t)sizeof(persistence::header);
+    if(new_file) {
+        persistence::header h;
+        memcpy(h.magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER));
+        h.version = LOG_FORMAT_VERSION;
+        if(!pwritev_all(segment.metadata_fd, {{&h, sizeof(h)}}, 0)) {
+            std::cerr << "ERROR: FileWriter could not write the header of "
+                      << filename << METADATA_EXTENSION << std::endl;
+        }
+    }
+
+    // Rebuild the index from the metadata records rather than trusting an
+    // existing index file, which may be stale; this only reads one record
+    // per INDEX_INTERVAL. A record left partially written by a crash is not
+    // counted, and is overwritten by the next batch.
+    std::vector<index_entry> index_entries;
+    bool checksummed = new_file;
+    {
+        LogReader existing(filename);
+        checksummed |= existing.valid() && existing.get_version() >= 2;
+        segment.num_records = existing.size();
+        for(uint64_t record = 0; record < segment.num_records; record += INDEX_INTERVAL) {
+            index_entries.push_back(make_index_entry(existing[record], record));
+        }
+        if(segment.num_records > 0) {
+            segment.first_record = existing[0];
+            segment.last_record = existing.latest();
+        }
+    }
+    segment.metadata_offset = LogReader::metadata_offset(segment.num_records);
+    if(segment.direct) {
+        segment.data_offset = round_up_to_page(segment.data_offset);
+    }
+    if(checksummed) {
+        // LogReader stopped at the first torn record; cut it and everything
+        // after it off both files, so that recovery tools and other nodes
+        // never see it and new records follow the last valid one
+        segment.data_offset = segment.num_records > 0
+                                  ? segment.last_record.offset + segment.last_record.length
+                                  : 0;
+        if(segment.direct) {
+            segment.data_offset = round_up_to_page(segment.data_offset);
+        }
+        if(ftruncate(segment.metadata_fd, segment.metadata_offset) != 0
+           || ftruncate(segment.data_fd, segment.data_offset) != 0) {
+            std::cerr << "WARNING: FileWriter could not truncate the torn end of "
+                      << filename << ": " << strerror(errno) << std::endl;
+        }
+    }
+    if(!write_index(segment.index_fd, index_entries, 0, segment.last_record, segment.num_records)
+       || ftruncate(segment.index_fd, index_entries.size() * sizeof(index_entry) + sizeof(index_trailer)) != 0) {
+        std::cerr << "WARNING: FileWriter could not write " << filename << INDEX_EXTENSION << std::endl;
+    }
+    segment.num_index_entries = index_entries.size();
+    return true;
+}
+
+/** Records that batch_metadata has been written, and updates the index. */
+void append_records(const std::string& filename, active_segment& segment,
+                    const std::vector<message_metadata>& batch_metadata,
+                    std::vector<index_entry>& new_index_entries) {
+    if(segment.num_records == 0) {
+        segment.first_record = batch_metadata.front();
+    }
+    segment.last_record = batch_metadata.back();
+    segment.metadata_offset += batch_metadata.size() * sizeof(message_metadata);
+    new_index_entries.clear();
+    for(const message_metadata& metadata : batch_metadata) {
+        if(segment.num_records % INDEX_INTERVAL == 0) {
+            new_index_entries.push_back(make_index_entry(metadata, segment.num_records));
+        }
+        segment.num_records++;
+    }
+    if(!write_index(segment.index_fd, new_index_entries, segment.num_index_entries,
+                    segment.last_record, segment.num_records)) {
+        std::cerr << "WARNING: FileWriter could not update " << filename << INDEX_EXTENSION << std::endl;
+    }
+    segment.num_index_entries += new_index_entries.size();
+}
+
+bool should_seal(const active_segment& segment, const segment_policy& policy) {
+    if(segment.num_records == 0) {
+        return false;
+    }
+    if(policy.max_segment_bytes && segment.data_offset >= policy.max_segment_bytes) {
+        return true;
+    }
+    return policy.max_segment_seconds
+           && std::chrono::steady_clock::now() - segment.opened
+                      >= std::chrono::seconds(policy.max_segment_seconds);
+}
+
+/** The manifest entry for segment, except for its number. */
+segment_info describe_segment(const active_segment& segment) {
+    return {0, segment.first_record.view_id, segment.first_record.index,
+            segment.last_record.view_id, segment.last_record.index,
+            segment.num_records, segment.data_offset + segment.metadata_offset};
+}
+
+#ifdef DERECHO_HAVE_LIBURING
+const unsigned int URING_ENTRIES = 64;
+
+/**
+ * Submits the same sequence of writes and syncs as pwritev_batch as a chain
+ * of linked io_uring requests, so the whole batch costs one system call.
+ * Returns false if the chain doesn't fit in the ring or any request fails or
+ * comes up short; the writes are positional, so the caller can simply redo
+ * the batch with pwritev_batch.
+ */
+bool uring_write_batch(io_uring& ring,
+                       int data_fd, const std::vector<iovec>& data_iov, uint64_t data_offset,
+                       int metadata_fd, const iovec& metadata_iov, uint64_t metadata_offset,
+                       durability_level durability) {
+    const bool sync = durability != DURABILITY_OS_BUFFERED;
+    const unsigned int fsync_flags = durability == DURABILITY_DATA_SYNC ? IORING_FSYNC_DATASYNC : 0;
+    size_t data_chunks = (data_iov.size() + IOV_MAX - 1) / IOV_MAX;
+    if(data_chunks + 3 > URING_ENTRIES) {
+        return false;
+    }
+    // The number of bytes each request should complete (0 for syncs)
+    std::vector<size_t> expected;
+    io_uring_sqe* sqe = nullptr;
+    for(size_t first = 0; first < data_iov.size(); first += IOV_MAX) {
+        unsigned int count = std::min<size_t>(data_iov.size() - first, IOV_MAX);
+        size_t bytes = 0;
+        for(size_t i = first; i < first + count; ++i) {
+            bytes += data_iov[i].iov_len;
+        }
+        sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_writev(sqe, data_fd, &data_iov[first], count, data_offset);
+        sqe->flags |= IOSQE_IO_LINK;
+        data_offset += bytes;
+        expected.push_back(bytes);
+    }
+    if(sync) {
+        sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_fsync(sqe, data_fd, fsync_flags);
+        sqe->flags |= IOSQE_IO_LINK;
+        expected.push_back(0);
+    }
+    sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_writev(sqe, metadata_fd, &metadata_iov, 1, metadata_offset);
+    expected.push_back(metadata_iov.iov_len);
+    if(sync) {
+        sqe->flags |= IOSQE_IO_LINK;
+        sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_fsync(sqe, metadata_fd, fsync_flags);
+        expected.push_back(0);
+    }
+
+    if(io_uring_submit_and_wait(&ring, expected.size()) < 0) {
+        return false;
+    }
+    // Completions of linked requests arrive in order
+    bool success = true;
+    for(size_t i = 0; i < expected.size(); ++i) {
+        io_uring_cqe* cqe;
+        if(io_uring_wait_cqe(&ring, &cqe) < 0) {
+            return false;
+        }
+        if(cqe->res < 0 || (size_t)cqe->res != expected[i]) {
+            success = false;
+        }
+        io_uring_cqe_seen(&ring, cqe);
+    }
+    return success;
+}
+#endif
+
+}  // namespace
 
-FileWriter::FileWriter(const std::function<void(message)>& _message_written_upcall,
-                       const std::string& filename)
-    : message_written_upcall(_message_written_upcall),
+FileWriter::FileWriter(const batch_upcall& _batch_written_upcall,
+                       const std::string& filename,
+                       durability_level durability,
+                       write_backend backend,
+                       segment_policy segments,
+                       bool direct_io)
+    : batch_written_upcall(_batch_written_upcall),
       exit(false),
+      durability(durability),
+      backend(backend),
+      filename(filename),
+      segments(segments),
+      direct_io(direct_io),
       writer_thread(&FileWriter::perform_writes, this, filename),
       callback_thread(&FileWriter::issue_callbacks, this) {}
 
@@ -40,71 +377,257 @@ FileWriter::~FileWriter() {
     if(callback_thread.joinable()) callback_thread.join();
 }
 
-void FileWriter::set_message_written_upcall(
-    const std::function<void(message)>& _message_written_upcall) {
-    message_written_upcall = _message_written_upcall;
+void FileWriter::set_batch_written_upcall(const batch_upcall& _batch_written_upcall) {
+    unique_lock<mutex> lock(pending_callbacks_mutex);
+    batch_written_upcall = _batch_written_upcall;
 }
 
-void FileWriter::perform_writes(std::string filename) {
-    ofstream data_file(filename, std::ios::app);
-    ofstream metadata_file(filename + METADATA_EXTENSION, std::ios::app);
+void FileWriter::load_segments(const std::string& filename) {
+    std::lock_guard<mutex> lock(segments_mutex);
+    sealed_segments = load_manifest(filename);
+    uint64_t number = sealed_segments.empty() ? 1 : sealed_segments.back().number + 1;
+    // A crash while sealing a segment can leave some of its files renamed
+    // and the manifest not yet updated; finish sealing it
+    std::string sealed_name = segment_filename(filename, number);
+    bool partly_sealed = false;
+    for(const std::string& suffix : {INDEX_EXTENSION, std::string(), METADATA_EXTENSION}) {
+        partly_sealed |= access((sealed_name + suffix).c_str(), F_OK) == 0;
+    }
+    if(!partly_sealed) {
+        return;
+    }
+    for(const std::string& suffix : {INDEX_EXTENSION, std::string(), METADATA_EXTENSION}) {
+        if(access((sealed_name + suffix).c_str(), F_OK) != 0) {
+            std::rename((filename + suffix).c_str(), (sealed_name + suffix).c_str());
+        }
+    }
+    LogReader sealed(sealed_name);
+    if(!sealed.valid() || sealed.size() == 0) {
+        return;
+    }
+    sealed_segments.push_back({number, sealed[0].view_id, sealed[0].index,
+                               sealed.latest().view_id, sealed.latest().index, sealed.size(),
+                               sealed.data_file_size() + sealed.metadata_file_size()});
+    save_manifest(filename, sealed_segments);
+}
 
-    unique_lock<mutex> writes_lock(pending_writes_mutex);
+bool FileWriter::seal_segment(const std::string& filename, const segment_info& segment) {
+    std::lock_guard<mutex> lock(segments_mutex);
+    segment_info sealed = segment;
+    sealed.number = sealed_segments.empty() ? 1 : sealed_segments.back().number + 1;
+    std::string sealed_name = segment_filename(filename, sealed.number);
+    // Same order as load_segments expects
+    for(const std::string& suffix : {INDEX_EXTENSION, std::string(), METADATA_EXTENSION}) {
+        if(std::rename((filename + suffix).c_str(), (sealed_name + suffix).c_str()) != 0) {
+            std::cerr << "ERROR: FileWriter could not seal segment " << sealed_name << suffix
+                      << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    sealed_segments.push_back(sealed);
+    return save_manifest(filename, sealed_segments);
+}
 
-    uint64_t current_offset = 0;
+uint64_t FileWriter::truncate_before(uint32_t view_id, uint64_t index) {
+    std::lock_guard<mutex> lock(segments_mutex);
+    // Segments are in message order, so the ones to delete are a prefix
+    auto first_kept = std::find_if(
+        sealed_segments.begin(), sealed_segments.end(), [&](const segment_info& segment) {
+            return std::make_tuple(segment.last_view_id, segment.last_index)
+                   >= std::make_tuple(view_id, index);
+        });
+    std::vector<segment_info> kept(first_kept, sealed_segments.end());
+    // Update the manifest first, so that it never lists a deleted segment
+    if(first_kept == sealed_segments.begin() || !save_manifest(filename, kept)) {
+        return 0;
+    }
+    uint64_t bytes_freed = 0;
+    for(auto segment = sealed_segments.begin(); segment != first_kept; ++segment) {
+        std::string sealed_name = segment_filename(filename, segment->number);
+        for(const std::string& suffix : {INDEX_EXTENSION, std::string(), METADATA_EXTENSION}) {
+            unlink((sealed_name + suffix).c_str());
+        }
+        bytes_freed += segment->bytes;
+    }
+    sealed_segments = std::move(kept);
+    return bytes_freed;
+}
 
-    persistence::header h;
-    memcpy(h.magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER));
-    h.version = 0;
-    metadata_file.write((char*)&h, sizeof(h));
+void FileWriter::perform_writes(std::string filename) {
+    load_segments(filename);
+    active_segment segment;
+    if(!open_segment(filename, direct_io, segment)) {
+        return;
+    }
 
-    while(!exit) {
-        pending_writes_cv.wait(writes_lock);
+#ifdef DERECHO_HAVE_LIBURING
+    io_uring ring;
+    bool use_uring = backend == IO_URING_BACKEND
+                     && io_uring_queue_init(URING_ENTRIES, &ring, 0) == 0;
+#else
+    if(backend == IO_URING_BACKEND) {
+        std::cerr << "WARNING: FileWriter was built without liburing; using pwritev" << std::endl;
+    }
+#endif
 
-        while(!pending_writes.empty()) {
-            using namespace std::placeholders;
+    std::vector<message> batch;
+    std::vector<message_metadata> batch_metadata;
+    std::vector<iovec> data_iov;
+    std::vector<index_entry> new_index_entries;
+    // Nonzero while a batch that failed to write is being retried
+    std::chrono::milliseconds retry_delay(0);
 
-            message m = pending_writes.front();
+    unique_lock<mutex> writes_lock(pending_writes_mutex);
+    while(true) {
+        if(retry_delay.count() == 0) {
+            pending_writes_cv.wait(writes_lock, [this]() { return exit || !pending_writes.empty(); });
+            batch.clear();
+        } else {
+            pending_writes_cv.wait_for(writes_lock, retry_delay, [this]() { return exit; });
+        }
+        if(exit) {
+            break;
+        }
+
+        // Take everything that has been queued so far as one batch, after
+        // the messages of a failed batch, which keep their place
+        while(!pending_writes.empty()) {
+            batch.push_back(pending_writes.front());
             pending_writes.pop();
+        }
+        writes_lock.unlock();
 
-            message_metadata metadata;
+        batch_metadata.clear();
+        data_iov.clear();
+        uint64_t batch_offset = segment.data_offset;
+        // With O_DIRECT, the memory written by the last iovec and the file
+        // offset it starts at, so that messages sharing its pages (those
+        // batched into the same buffer) are written with it
+        uintptr_t extent_start = 0;
+        uintptr_t extent_end = 0;
+        uint64_t extent_offset = 0;
+        for(const message& m : batch) {
+            message_metadata metadata = {};
             metadata.view_id = m.view_id;
             metadata.sender = m.sender;
+            metadata.sender_rank = m.sender_rank;
             metadata.index = m.index;
-            metadata.offset = current_offset;
+            metadata.offset = segment.data_offset;
             metadata.length = m.length;
             metadata.is_cooked = m.cooked;
+            if(segment.direct && m.length > 0) {
+                // O_DIRECT needs page-aligned memory, file offsets and sizes,
+                // so write the whole pages that hold the message, along with
+                // those of the messages before it in the same buffer
+                uintptr_t first_page = (uintptr_t)m.data / page_size * page_size;
+                uintptr_t last_page_end = round_up_to_page((uintptr_t)m.data + m.length);
+                if(data_iov.empty() || first_page < extent_start || first_page >= extent_end) {
+                    extent_start = first_page;
+                    extent_end = first_page;
+                    extent_offset = segment.data_offset;
+                    data_iov.push_back({(void*)first_page, 0});
+                }
+                if(last_page_end > extent_end) {
+                    data_iov.back().iov_len += last_page_end - extent_end;
+                    segment.data_offset += last_page_end - extent_end;
+                    extent_end = last_page_end;
+                }
+                metadata.offset = extent_offset + ((uintptr_t)m.data - extent_start);
+            } else {
+                if(m.length > 0) {
+                    data_iov.push_back({m.data, m.length});
+                }
+                segment.data_offset += m.length;
+            }
+            metadata.checksum = record_checksum(metadata, m.data);
+            batch_metadata.push_back(metadata);
+        }
+        iovec metadata_iov{batch_metadata.data(), batch_metadata.size() * sizeof(message_metadata)};
 
-            data_file.write(m.data, m.length);
-            mutils::post_object(std::bind(&std::ofstream::write, &metadata_file, _1, _2), metadata);
-
-            data_file.flush();
-            metadata_file.flush();
+        bool written = false;
+#ifdef DERECHO_HAVE_LIBURING
+        if(use_uring) {
+            written = uring_write_batch(ring, segment.data_fd, data_iov, batch_offset,
+                                        segment.metadata_fd, metadata_iov, segment.metadata_offset,
+                                        durability);
+        }
+#endif
+        if(!written) {
+            written = pwritev_batch(segment.data_fd, data_iov, batch_offset,
+                                    segment.metadata_fd, metadata_iov, segment.metadata_offset,
+                                    durability);
+        }
 
-            current_offset += m.length;
+        if(written) {
+            if(retry_delay.count() != 0) {
+                std::cerr << "FileWriter is writing to " << filename << " again" << std::endl;
+                retry_delay = std::chrono::milliseconds(0);
+            }
+            append_records(filename, segment, batch_metadata, new_index_entries);
 
             {
                 unique_lock<mutex> callbacks_lock(pending_callbacks_mutex);
-                pending_callbacks.push(std::bind(message_written_upcall, m));
+                pending_callbacks.push(batch);
             }
             pending_callbacks_cv.notify_all();
+        } else {
+            // Don't report messages as persisted if they may not be, nor any
+            // later ones, which would move persisted_num past them: keep
+            // retrying this batch, with later messages appended to it
+            if(retry_delay.count() == 0) {
+                std::cerr << "ERROR: FileWriter failed to write " << batch.size()
+                          << " messages to " << filename << ": " << strerror(errno)
+                          << "; retrying" << std::endl;
+            }
+            retry_delay = std::min(std::max(2 * retry_delay, std::chrono::milliseconds(10)),
+                                   std::chrono::milliseconds(1000));
+            // The retry overwrites whatever part of this batch was written
+            segment.data_offset = batch_offset;
+        }
+
+        if(should_seal(segment, segments)) {
+            segment_info sealed = describe_segment(segment);
+            close_segment(segment);
+            seal_segment(filename, sealed);
+            if(!open_segment(filename, direct_io, segment)) {
+                return;
+            }
         }
+
+        writes_lock.lock();
     }
+
+#ifdef DERECHO_HAVE_LIBURING
+    if(use_uring) {
+        io_uring_queue_exit(&ring);
+    }
+#endif
+    close_segment(segment);
 }
 
+
 void FileWriter::issue_callbacks() {
     unique_lock<mutex> lock(pending_callbacks_mutex);
+    std::vector<message> written;
 
     while(!exit) {
-        pending_callbacks_cv.wait(lock);
+        pending_callbacks_cv.wait(lock, [this]() { return exit || !pending_callbacks.empty(); });
+        if(pending_callbacks.empty()) {
+            continue;
+        }
 
+        // Coalesce every batch written since the last upcall
+        written = std::move(pending_callbacks.front());
+        pending_callbacks.pop();
         while(!pending_callbacks.empty()) {
-            auto callback = pending_callbacks.front();
+            written.insert(written.end(), pending_callbacks.front().begin(),
+                           pending_callbacks.front().end());
             pending_callbacks.pop();
-            lock.unlock();
-            callback();
-            lock.lock();
         }
+        batch_upcall upcall = batch_written_upcall;
+        lock.unlock();
+        upcall(written);
+        lock.lock();
     }
 }
 
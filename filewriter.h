@@ -3,16 +3,47 @@
 #include <atomic>
 #include <condition_variable>
 #include <cstdint>
-#include <fstream>
+#include <functional>
 #include <mutex>
 #include <queue>
 #include <string>
 #include <thread>
+#include <vector>
 
+#include "log_manifest.h"
 #include "persistence.h"
 
 namespace derecho {
 
+/** How durable a message must be before FileWriter reports it persisted. */
+enum durability_level : uint32_t {
+    /** Handed to the OS; lost if the machine crashes before writeback. */
+    DURABILITY_OS_BUFFERED = 0,
+    /** fdatasync'd to the device, once per batch of messages. */
+    DURABILITY_DATA_SYNC = 1,
+    /** fsync'd, which also flushes file metadata such as timestamps. */
+    DURABILITY_FULL_SYNC = 2,
+};
+
+/** The system interface FileWriter uses to write and sync a batch. */
+enum write_backend : uint32_t {
+    /** One pwritev per file, then fdatasync/fsync. */
+    PWRITEV_BACKEND = 0,
+    /** The same writes and syncs as one chain of linked io_uring requests,
+     * submitted with a single system call. Falls back to PWRITEV_BACKEND
+     * if Derecho was built without liburing. */
+    IO_URING_BACKEND = 1,
+};
+
+/** When FileWriter seals the segment it is appending to and starts a new
+ * one; a limit of 0 is disabled. With both disabled the log is one file. */
+struct segment_policy {
+    /** Seal a segment once its data file has grown to this many bytes. */
+    uint64_t max_segment_bytes = 0;
+    /** Seal a segment after writing to it for this many seconds. */
+    uint32_t max_segment_seconds = 0;
+};
+
 class FileWriter {
 public:
     //  const uint32_t MSG_LOCALLY_STABLE = 0x1;
@@ -20,8 +51,12 @@ public:
     //  const uint32_t MSG_GLOBAL_STABLE = 0x4;
     //  const uint32_t MSG_LOCALLY_PERSISTENT = 0x8;
 
+    using batch_upcall = std::function<void(const std::vector<persistence::message>&)>;
+
 private:
-    std::function<void(persistence::message)> message_written_upcall;
+    /** Guarded by pending_callbacks_mutex, since it can be replaced while
+     * the callback thread is running. */
+    batch_upcall batch_written_upcall;
 
     std::mutex pending_writes_mutex;
     std::condition_variable pending_writes_cv;
@@ -29,19 +64,54 @@ private:
 
     std::mutex pending_callbacks_mutex;
     std::condition_variable pending_callbacks_cv;
-    std::queue<std::function<void()>> pending_callbacks;
+    /** Batches that have been written, waiting for their upcall. */
+    std::queue<std::vector<persistence::message>> pending_callbacks;
 
     bool exit;
 
+    const durability_level durability;
+    const write_backend backend;
+    const std::string filename;
+    const segment_policy segments;
+    const bool direct_io;
+
+    /** Guards sealed_segments and the manifest, which are changed both by
+     * the writer thread and by truncate_before. */
+    std::mutex segments_mutex;
+    std::vector<persistence::segment_info> sealed_segments;
+
     std::thread writer_thread;
     std::thread callback_thread;
 
     void perform_writes(std::string filename);
     void issue_callbacks();
+    void load_segments(const std::string& filename);
+    bool seal_segment(const std::string& filename, const persistence::segment_info& segment);
 
 public:
-    FileWriter(const std::function<void(persistence::message)> &_message_written_upcall,
-               const std::string &filename);
+    /**
+     * Starts writing messages to filename (and its metadata file). Messages
+     * are written in batches: everything queued while the previous batch was
+     * being written goes out with one vectored write per file and one sync
+     * (group commit), and once the whole batch has reached the requested
+     * durability the upcall is issued once for it, with its messages in the
+     * order they were written. If the upcall falls behind, the batches
+     * written in the meantime are passed to the next upcall together. Depending on the
+     * segment policy, the log is split into segments listed in a manifest.
+     *
+     * With direct_io, the data file is opened with O_DIRECT and messages are
+     * written straight from the pages of memory that hold them. Messages
+     * that share pages (a batch in one buffer) are written together, so
+     * each buffer's messages take up whole pages of the data file, starting
+     * at the same offset within their first page as in memory; a message
+     * sent on its own takes at least one page.
+     */
+    FileWriter(const batch_upcall &_batch_written_upcall,
+               const std::string &filename,
+               durability_level durability = DURABILITY_DATA_SYNC,
+               write_backend backend = PWRITEV_BACKEND,
+               segment_policy segments = segment_policy(),
+               bool direct_io = false);
     ~FileWriter();
 
     FileWriter(FileWriter &) = delete;
@@ -50,8 +120,14 @@ public:
     FileWriter &operator=(FileWriter &) = delete;
     FileWriter &operator=(FileWriter &&) = default;
 
-    void set_message_written_upcall(const std::function<void(persistence::message)> &
-                                        _message_written_upcall);
+    void set_batch_written_upcall(const batch_upcall &_batch_written_upcall);
     void write_message(persistence::message m);
+    /**
+     * Deletes every sealed segment whose messages all come before message
+     * number (view_id, index), i.e. are covered by an application checkpoint.
+     * The segment being appended to is never deleted.
+     * @return the number of bytes freed
+     */
+    uint64_t truncate_before(uint32_t view_id, uint64_t index);
 };
 }
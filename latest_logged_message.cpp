@@ -8,12 +8,10 @@
  */
 
 #include <iostream>
-#include <fstream>
+#include <memory>
 #include <string>
-#include <strings.h>
 
-#include "serialization/SerializationSupport.hpp"
-#include "persistence.h"
+#include "log_reader.h"
 
 using namespace derecho::persistence;
 
@@ -24,15 +22,16 @@ int main(int argc, char* argv[]) {
     }
 
     std::string filename(argv[1]);
-    std::ifstream metadata_file(filename + METADATA_EXTENSION);
-    //Since metadatas are written in chronological order, the one at the end
-    //of the file is the latest one.
-    message_metadata dummy_for_size;
-    std::size_t size_of_metadata = mutils::bytes_size(dummy_for_size);
-    metadata_file.seekg(-1 * size_of_metadata, std::ios::end);
-    char buffer[size_of_metadata];
-    metadata_file.read(buffer, size_of_metadata);
-    std::unique_ptr<message_metadata> metadata = mutils::from_bytes<message_metadata>(nullptr, buffer);
-    std::cout << metadata->view_id << " " << metadata->sender << " " << metadata->index << std::endl;
+    //If the current segment was just sealed, the latest message is at the end
+    //of the newest sealed segment
+    std::unique_ptr<derecho::LogReader> log = derecho::LogReader::open_latest(filename);
+    if(!log->valid() || log->size() == 0) {
+        std::cerr << "No messages logged in " << filename << std::endl;
+        return 1;
+    }
+    //Since metadatas are written in chronological order, the last record (or
+    //the copy of it in the index trailer) is the latest one.
+    const message_metadata& metadata = log->latest();
+    std::cout << metadata.view_id << " " << metadata.sender << " " << metadata.index << std::endl;
     return 0;
 }
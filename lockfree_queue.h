@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace derecho {
+
+/** Rounds n up to the next power of two (at least 1). */
+inline size_t next_power_of_two(size_t n) {
+    size_t power = 1;
+    while(power < n) {
+        power <<= 1;
+    }
+    return power;
+}
+
+/**
+ * A bounded, wait-free queue for exactly one producer thread and one consumer
+ * thread. Elements are moved in and out of a fixed ring of slots, so pushing
+ * and popping never allocate. T must be default-constructible and movable.
+ */
+template <typename T>
+class spsc_queue {
+    const size_t mask;
+    std::unique_ptr<T[]> slots;
+    /** Next slot to pop; written only by the consumer. */
+    alignas(64) std::atomic<size_t> head{0};
+    /** Next slot to push; written only by the producer. */
+    alignas(64) std::atomic<size_t> tail{0};
+
+public:
+    spsc_queue(size_t capacity)
+        : mask(next_power_of_two(capacity) - 1),
+          slots(new T[mask + 1]) {}
+    spsc_queue(const spsc_queue&) = delete;
+    spsc_queue& operator=(const spsc_queue&) = delete;
+
+    /** Producer only. Returns false (and leaves item alone) if the queue is full. */
+    bool push(T&& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) > mask) {
+            return false;
+        }
+        slots[t & mask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Consumer only. Returns the oldest element without removing it, or
+     * nullptr if the queue is empty. */
+    T* front() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots[h & mask];
+    }
+
+    /** Consumer only. Removes the element returned by front(). */
+    void pop() {
+        size_t h = head.load(std::memory_order_relaxed);
+        slots[h & mask] = T();
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    /** Consumer only. Moves the oldest element into item; returns false if
+     * the queue is empty. */
+    bool pop(T& item) {
+        T* f = front();
+        if(!f) {
+            return false;
+        }
+        item = std::move(*f);
+        pop();
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
+
+/**
+ * A bounded queue that any number of threads may push to and pop from
+ * concurrently without locking (Vyukov's array-based MPMC queue). Each slot
+ * carries a sequence number that tells producers and consumers whether it is
+ * free or full for the current lap around the ring.
+ */
+template <typename T>
+class mpmc_queue {
+    struct cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    const size_t mask;
+    std::unique_ptr<cell[]> cells;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+
+public:
+    mpmc_queue(size_t capacity)
+        : mask(next_power_of_two(capacity) - 1),
+          cells(new cell[mask + 1]) {
+        for(size_t i = 0; i <= mask; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    /** Returns false (and leaves item alone) if the queue is full. */
+    bool push(T&& item) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        cell* c;
+        while(true) {
+            c = &cells[pos & mask];
+            size_t seq = c->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0) {
+                if(enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if(diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        c->data = std::move(item);
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Moves an element into item; returns false if the queue is empty. */
+    bool pop(T& item) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        cell* c;
+        while(true) {
+            c = &cells[pos & mask];
+            size_t seq = c->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(diff == 0) {
+                if(dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if(diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(c->data);
+        c->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+}  // namespace derecho
@@ -0,0 +1,101 @@
+#include "log_manifest.h"
+#include "persistence.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace derecho {
+namespace persistence {
+
+std::string segment_filename(const std::string& filename, uint64_t number) {
+    return filename + "." + std::to_string(number);
+}
+
+std::vector<segment_info> load_manifest(const std::string& filename) {
+    std::vector<segment_info> segments;
+    std::ifstream manifest(filename + MANIFEST_EXTENSION);
+    segment_info segment;
+    while(manifest >> segment.number >> segment.first_view_id >> segment.first_index
+          >> segment.last_view_id >> segment.last_index >> segment.num_records >> segment.bytes) {
+        segments.push_back(segment);
+    }
+    return segments;
+}
+
+namespace {
+/** Writes all of contents to a new file called name and syncs it to disk. */
+bool write_file_durably(const std::string& name, const std::string& contents) {
+    int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if(fd < 0) {
+        return false;
+    }
+    const char* data = contents.data();
+    size_t remaining = contents.size();
+    while(remaining > 0) {
+        ssize_t written = write(fd, data, remaining);
+        if(written < 0 && errno == EINTR) {
+            continue;
+        }
+        if(written <= 0) {
+            close(fd);
+            return false;
+        }
+        data += written;
+        remaining -= written;
+    }
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
+
+/** Syncs the directory holding filename, so that a rename or unlink of an
+ * entry in it survives a crash. */
+bool sync_parent_directory(const std::string& filename) {
+    size_t slash = filename.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : filename.substr(0, slash);
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if(fd < 0) {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
+}  // namespace
+
+bool save_manifest(const std::string& filename, const std::vector<segment_info>& segments) {
+    std::string manifest_name = filename + MANIFEST_EXTENSION;
+    std::ostringstream manifest;
+    for(const segment_info& segment : segments) {
+        manifest << segment.number << " " << segment.first_view_id << " " << segment.first_index << " "
+                 << segment.last_view_id << " " << segment.last_index << " "
+                 << segment.num_records << " " << segment.bytes << "\n";
+    }
+    // The new manifest must be on disk before it replaces the old one, and
+    // the replacement before the caller deletes any segment the old one
+    // lists; otherwise a crash could bring back a manifest naming segments
+    // that are gone
+    if(!write_file_durably(manifest_name + SWAP_FILE_EXTENSION, manifest.str())) {
+        std::cerr << "Error writing log manifest to disk! " << strerror(errno) << std::endl;
+        return false;
+    }
+    if(std::rename((manifest_name + SWAP_FILE_EXTENSION).c_str(), manifest_name.c_str()) < 0) {
+        std::cerr << "Error updating log manifest on disk! " << strerror(errno) << std::endl;
+        return false;
+    }
+    if(!sync_parent_directory(manifest_name)) {
+        std::cerr << "Error syncing log manifest's directory! " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace persistence
+}  // namespace derecho
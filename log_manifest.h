@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace derecho {
+namespace persistence {
+
+/**
+ * A persistent log is split into segments. The newest segment is the one
+ * being appended to, and keeps the log's own filename (with its .metadata
+ * and .index files next to it); when it is sealed, its three files are
+ * renamed to segment_filename(filename, number) and it is recorded in the
+ * manifest, <filename>.manifest.
+ */
+static const std::string MANIFEST_EXTENSION = ".manifest";
+
+/** A sealed segment, as recorded in the manifest. */
+struct segment_info {
+    uint64_t number;
+    uint32_t first_view_id;
+    uint64_t first_index;
+    uint32_t last_view_id;
+    uint64_t last_index;
+    uint64_t num_records;
+    /** The total size of the segment's data and metadata files. */
+    uint64_t bytes;
+};
+
+std::string segment_filename(const std::string& filename, uint64_t number);
+
+/**
+ * Reads the manifest of the log called filename. The manifest is a text file
+ * with one line per sealed segment, oldest first, holding the fields of
+ * segment_info in order.
+ * @return the sealed segments, or an empty vector if there is no manifest.
+ */
+std::vector<segment_info> load_manifest(const std::string& filename);
+
+/** Replaces the manifest, through a swap file so that a crash leaves either
+ * the old or the new manifest. Once it returns true the new manifest is on
+ * disk, so segments only the old one listed can safely be deleted. */
+bool save_manifest(const std::string& filename, const std::vector<segment_info>& segments);
+
+}  // namespace persistence
+}  // namespace derecho
@@ -0,0 +1,236 @@
+#include "log_reader.h"
+#include "log_manifest.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+namespace derecho {
+
+using namespace persistence;
+
+namespace {
+
+/** Records are sorted by this key; messages with the same key differ only
+ * by sender, in the order of the senders' ranks. */
+std::tuple<uint32_t, uint64_t> sort_key(const message_metadata& record) {
+    return std::make_tuple(record.view_id, record.index);
+}
+
+std::tuple<uint32_t, uint64_t> sort_key(const index_entry& entry) {
+    return std::make_tuple(entry.view_id, entry.index);
+}
+
+/** Maps the whole file read-only; returns nullptr if it's shorter than min_size. */
+const char* map_file(const std::string& name, size_t min_size, int& fd, size_t& size) {
+    fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return nullptr;
+    }
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < min_size || file_stat.st_size == 0) {
+        return nullptr;
+    }
+    size = file_stat.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED) {
+        size = 0;
+        return nullptr;
+    }
+    return (const char*)map;
+}
+
+}  // namespace
+
+LogReader::LogReader(const std::string& filename) : filename(filename) {
+    metadata_map = map_file(filename + METADATA_EXTENSION, sizeof(header),
+                            metadata_fd, metadata_size);
+    if(!metadata_map) {
+        return;
+    }
+    const header* h = (const header*)metadata_map;
+    if(memcmp(h->magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER)) != 0 || h->version > LOG_FORMAT_VERSION) {
+        munmap((void*)metadata_map, metadata_size);
+        metadata_map = nullptr;
+        return;
+    }
+    version = h->version;
+    data_fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    records = (const message_metadata*)(metadata_map + sizeof(header));
+    // A partially written record at the end is not part of the log
+    num_records = (metadata_size - sizeof(header)) / sizeof(message_metadata);
+    if(version >= 2) {
+        num_records = validate_tail();
+    }
+    open_index();
+}
+
+size_t LogReader::validate_tail() const {
+    // Only the records of the last few batches can have been torn by a
+    // crash, so check a bounded window at the end rather than the whole log
+    size_t first = num_records;
+    uint64_t window_data = 0;
+    while(first > 0 && num_records - first < VALIDATION_RECORDS
+          && (first == num_records || window_data + records[first - 1].length <= VALIDATION_BYTES)) {
+        first--;
+        window_data += records[first].length;
+    }
+    // Records in a segment are written in increasing order of offset (with
+    // gaps between them if the log was written with O_DIRECT), so the whole
+    // window's data can be read at once
+    uint64_t file_size = data_file_size();
+    uint64_t window_start = first < num_records ? records[first].offset : 0;
+    uint64_t window_end = window_start;
+    for(size_t record = first; record < num_records; ++record) {
+        const message_metadata& metadata = records[record];
+        if(metadata.offset < window_end || metadata.offset + metadata.length > file_size) {
+            return record;
+        }
+        window_end = metadata.offset + metadata.length;
+    }
+    std::vector<char> data(window_end - window_start);
+    if(!read_data(window_start, data.size(), data.data())) {
+        return first;
+    }
+    for(size_t record = first; record < num_records; ++record) {
+        const char* record_data = data.data() + (records[record].offset - window_start);
+        if(record_checksum(records[record], record_data) != records[record].checksum) {
+            return record;
+        }
+    }
+    return num_records;
+}
+
+bool LogReader::verify(size_t record_number) const {
+    const message_metadata& metadata = records[record_number];
+    std::vector<char> data(metadata.length);
+    return read_data(metadata.offset, metadata.length, data.data())
+           && record_checksum(metadata, data.data()) == metadata.checksum;
+}
+
+void LogReader::open_index() {
+    index_map = map_file(filename + INDEX_EXTENSION, sizeof(index_trailer), index_fd, index_size);
+    if(!index_map) {
+        return;
+    }
+    size_t entries_size = index_size - sizeof(index_trailer);
+    const index_trailer* t = (const index_trailer*)(index_map + entries_size);
+    if(entries_size % sizeof(index_entry) != 0
+       || memcmp(t->magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER)) != 0
+       || t->num_entries != entries_size / sizeof(index_entry)) {
+        return;
+    }
+    entries = (const index_entry*)index_map;
+    num_entries = t->num_entries;
+    // Only use the entries that refer to records that are actually present
+    while(num_entries > 0 && entries[num_entries - 1].record_number >= num_records) {
+        num_entries--;
+    }
+    if(t->num_records == num_records) {
+        trailer = t;
+    }
+}
+
+LogReader::~LogReader() {
+    if(metadata_map) {
+        munmap((void*)metadata_map, metadata_size);
+    }
+    if(index_map) {
+        munmap((void*)index_map, index_size);
+    }
+    if(metadata_fd >= 0) {
+        close(metadata_fd);
+    }
+    if(index_fd >= 0) {
+        close(index_fd);
+    }
+    if(data_fd >= 0) {
+        close(data_fd);
+    }
+}
+
+std::unique_ptr<LogReader> LogReader::open_latest(const std::string& filename) {
+    auto log = std::make_unique<LogReader>(filename);
+    if(!log->valid() || log->size() == 0) {
+        auto sealed_segments = load_manifest(filename);
+        if(!sealed_segments.empty()) {
+            log = std::make_unique<LogReader>(segment_filename(filename, sealed_segments.back().number));
+        }
+    }
+    return log;
+}
+
+const message_metadata& LogReader::latest() const {
+    if(trailer) {
+        return trailer->last_record;
+    }
+    return records[num_records - 1];
+}
+
+size_t LogReader::find(uint32_t view_id, uint32_t sender, uint64_t index) const {
+    auto target = std::make_tuple(view_id, index);
+    // Narrow the search to the records between the last index entry before
+    // the target and the first one after it
+    size_t first = 0, last = num_records;
+    const index_entry* entries_end = entries + num_entries;
+    const index_entry* after = std::upper_bound(
+        entries, entries_end, target,
+        [](const std::tuple<uint32_t, uint64_t>& key, const index_entry& entry) {
+            return key < sort_key(entry);
+        });
+    if(after != entries_end) {
+        last = after->record_number;
+    }
+    const index_entry* before = std::lower_bound(
+        entries, after, target,
+        [](const index_entry& entry, const std::tuple<uint32_t, uint64_t>& key) {
+            return sort_key(entry) < key;
+        });
+    if(before != entries) {
+        first = (before - 1)->record_number;
+    }
+
+    const message_metadata* record = std::lower_bound(
+        records + first, records + last, target,
+        [](const message_metadata& record, const std::tuple<uint32_t, uint64_t>& key) {
+            return sort_key(record) < key;
+        });
+    for(; record != records + last && sort_key(*record) == target; ++record) {
+        if(record->sender == sender) {
+            return record - records;
+        }
+    }
+    return num_records;
+}
+
+uint64_t LogReader::data_file_size() const {
+    struct stat file_stat;
+    if(fstat(data_fd, &file_stat) != 0) {
+        return 0;
+    }
+    return file_stat.st_size;
+}
+
+bool LogReader::read_data(uint64_t offset, uint64_t size, char* buffer) const {
+    while(size > 0) {
+        ssize_t bytes_read = pread(data_fd, buffer, size, offset);
+        if(bytes_read <= 0) {
+            if(bytes_read < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buffer += bytes_read;
+        offset += bytes_read;
+        size -= bytes_read;
+    }
+    return true;
+}
+
+}  // namespace derecho
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "persistence.h"
+
+namespace derecho {
+
+/**
+ * Read-only access to a persistent log written by FileWriter. The metadata
+ * file is memory-mapped, so records are accessed in place by record number,
+ * and a message is found by its (view_id, sender, index) number by using the
+ * sparse index to narrow the search to one interval of records. If the index
+ * file is missing or only covers part of the log, the rest is binary searched
+ * directly, which works because records are in delivery order.
+ *
+ * In logs of version 2 and later, the records at the end of the log are
+ * checked against their checksums when it is opened, and the log is treated
+ * as ending just before the first one that is torn or corrupt.
+ */
+class LogReader {
+    std::string filename;
+    int data_fd = -1;
+    int metadata_fd = -1;
+    size_t metadata_size = 0;
+    const char* metadata_map = nullptr;
+    uint32_t version = 0;
+    const persistence::message_metadata* records = nullptr;
+    size_t num_records = 0;
+
+    int index_fd = -1;
+    size_t index_size = 0;
+    const char* index_map = nullptr;
+    /** The prefix of the index entries that refer to records in the log. */
+    const persistence::index_entry* entries = nullptr;
+    size_t num_entries = 0;
+    /** The index trailer, if it describes the current metadata file. */
+    const persistence::index_trailer* trailer = nullptr;
+
+    /** How far back from the end of the log validate_tail checks records. */
+    static const size_t VALIDATION_RECORDS = 1024;
+    static const uint64_t VALIDATION_BYTES = 16 << 20;
+
+    void open_index();
+    /** Checks the checksums of the last records of the log (at least one,
+     * and up to VALIDATION_RECORDS or VALIDATION_BYTES of data).
+     * @return the number of records before the first invalid one */
+    size_t validate_tail() const;
+
+public:
+    LogReader(const std::string& filename);
+    ~LogReader();
+
+    LogReader(const LogReader&) = delete;
+    LogReader& operator=(const LogReader&) = delete;
+
+    /** Opens the current segment of the log called filename, or the newest
+     * sealed segment if the current one has no messages yet. */
+    static std::unique_ptr<LogReader> open_latest(const std::string& filename);
+
+    /** False if the metadata file doesn't exist or has no valid header. */
+    bool valid() const { return metadata_map != nullptr; }
+    uint32_t get_version() const { return version; }
+
+    /** The number of complete (and, from version 2, valid) metadata records
+     * in the log. */
+    size_t size() const { return num_records; }
+    const persistence::message_metadata& operator[](size_t record_number) const {
+        return records[record_number];
+    }
+    /** The last record in the log; the log must not be empty. */
+    const persistence::message_metadata& latest() const;
+
+    /** Checks a record and its data against its checksum, which only logs
+     * of version 2 and later have. */
+    bool verify(size_t record_number) const;
+
+    /**
+     * Finds the record for message (view_id, sender, index).
+     * @return its record number, or size() if it isn't in the log.
+     */
+    size_t find(uint32_t view_id, uint32_t sender, uint64_t index) const;
+
+    /** The position of a record within the metadata file. */
+    static uint64_t metadata_offset(size_t record_number) {
+        return sizeof(persistence::header) + record_number * sizeof(persistence::message_metadata);
+    }
+    uint64_t metadata_file_size() const { return metadata_size; }
+    /** The size of the data file, or 0 if it can't be opened. */
+    uint64_t data_file_size() const;
+    /** Reads size bytes of the data file, starting at offset, into buffer. */
+    bool read_data(uint64_t offset, uint64_t size, char* buffer) const;
+};
+
+}  // namespace derecho
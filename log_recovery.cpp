@@ -0,0 +1,385 @@
+#include "log_recovery.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+
+#include "checksum.h"
+#include "filewriter.h"
+#include "log_manifest.h"
+
+namespace derecho {
+
+using namespace persistence;
+
+namespace {
+
+enum recovery_request_type : uint32_t {
+    /** Asks for the node's latest logged message and saved view */
+    RECOVERY_STATE = 0,
+    /** Asks for the messages after the requester's latest one */
+    RECOVERY_TAIL = 1,
+};
+
+struct __attribute__((__packed__)) recovery_request {
+    uint32_t type;
+    /** For RECOVERY_TAIL: whether the requester has any messages, and the
+     * number of its latest one. */
+    uint8_t has_messages;
+    uint8_t padding0;
+    uint16_t padding1;
+    uint32_t view_id;
+    uint32_t sender;
+    uint64_t index;
+};
+
+/** Followed by view_file_size bytes of the saved view file. */
+struct __attribute__((__packed__)) state_reply {
+    uint8_t has_messages;
+    message_metadata latest;
+    uint64_t view_file_size;
+};
+
+/** Followed by the tail in chunks, if the requester's latest message was
+ * found. */
+struct __attribute__((__packed__)) tail_reply {
+    uint8_t found;
+    uint64_t num_records;
+};
+
+/** Followed by num_records metadata records, then the data of those
+ * messages, packed in order. The checksum covers both. */
+struct __attribute__((__packed__)) chunk_header {
+    uint32_t num_records;
+    uint32_t checksum;
+    uint64_t data_size;
+};
+
+const size_t RECORDS_PER_CHUNK = 1024;
+/** replay_log reads contiguous messages from disk in reads of about this size. */
+const uint64_t REPLAY_READ_SIZE = 1 << 20;
+
+/** Copies the data of records [first, last) of log into buffer, packed. */
+bool read_records_data(const LogReader& log, size_t first, size_t last, char* buffer) {
+    size_t start = first;
+    while(start < last) {
+        // Records in one segment normally have consecutive offsets, so
+        // their data can be read at once
+        size_t end = start + 1;
+        while(end < last && log[end].offset == log[end - 1].offset + log[end - 1].length) {
+            end++;
+        }
+        uint64_t size = log[end - 1].offset + log[end - 1].length - log[start].offset;
+        if(!log.read_data(log[start].offset, size, buffer)) {
+            return false;
+        }
+        buffer += size;
+        start = end;
+    }
+    return true;
+}
+
+/** Sends records first onwards of log, a segment of the log called
+ * filename, in chunks, as fetch_log_tail expects them. */
+bool send_records(tcp::socket& socket, const LogReader& log, size_t first,
+                  const std::string& filename) {
+    std::vector<char> buffer;
+    for(size_t chunk_start = first; chunk_start < log.size(); chunk_start += RECORDS_PER_CHUNK) {
+        size_t chunk_end = std::min(chunk_start + RECORDS_PER_CHUNK, log.size());
+        size_t records_size = (chunk_end - chunk_start) * sizeof(message_metadata);
+        chunk_header header;
+        header.num_records = chunk_end - chunk_start;
+        header.data_size = 0;
+        for(size_t record = chunk_start; record < chunk_end; ++record) {
+            header.data_size += log[record].length;
+        }
+        buffer.resize(records_size + header.data_size);
+        memcpy(buffer.data(), &log[chunk_start], records_size);
+        if(!read_records_data(log, chunk_start, chunk_end, buffer.data() + records_size)) {
+            std::cerr << "WARNING: could not read " << filename << " to send its tail" << std::endl;
+            return false;
+        }
+        header.checksum = crc32c(0, buffer.data(), buffer.size());
+        if(!socket.write((char*)&header, sizeof(header))
+           || !socket.write(buffer.data(), buffer.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+LogRecoveryServer::LogRecoveryServer(const std::string& filename, uint32_t port)
+    : filename(filename),
+      port(port),
+      listener(port),
+      shutdown(false),
+      listener_thread([this]() {
+          while(!shutdown) {
+              tcp::socket socket = listener.accept();
+              if(shutdown) {
+                  break;
+              }
+              std::lock_guard<std::mutex> lock(connection_threads_mutex);
+              reap_connection_threads();
+              connection_threads.emplace_back();
+              connection_thread& connection = connection_threads.back();
+              connection.thread = std::thread([this, &connection](tcp::socket socket) {
+                  serve(std::move(socket));
+                  connection.done = true;
+              },
+                                              std::move(socket));
+          }
+      }) {}
+
+void LogRecoveryServer::reap_connection_threads() {
+    for(auto it = connection_threads.begin(); it != connection_threads.end();) {
+        if(it->done) {
+            it->thread.join();
+            it = connection_threads.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+LogRecoveryServer::~LogRecoveryServer() {
+    shutdown = true;
+    // force accept to return.
+    try {
+        tcp::socket s{"localhost", (int)port};
+    } catch(tcp::exception&) {
+    }
+    if(listener_thread.joinable()) {
+        listener_thread.join();
+    }
+    for(auto& connection : connection_threads) {
+        connection.thread.join();
+    }
+}
+
+void LogRecoveryServer::serve(tcp::socket socket) {
+    recovery_request request;
+    if(!socket.read((char*)&request, sizeof(request))) {
+        return;
+    }
+    if(request.type == RECOVERY_STATE) {
+        state_reply reply = {};
+        std::unique_ptr<LogReader> log = LogReader::open_latest(filename);
+        if(log->valid() && log->size() > 0) {
+            reply.has_messages = true;
+            reply.latest = log->latest();
+        }
+        std::ifstream view_file(filename + PAXOS_STATE_EXTENSION, std::ios::binary);
+        std::vector<char> view_bytes((std::istreambuf_iterator<char>(view_file)),
+                                     std::istreambuf_iterator<char>());
+        reply.view_file_size = view_bytes.size();
+        if(socket.write((char*)&reply, sizeof(reply)) && !view_bytes.empty()) {
+            socket.write(view_bytes.data(), view_bytes.size());
+        }
+        return;
+    }
+
+    // The tail may start in any segment the manifest still lists, and runs
+    // through every later one
+    std::vector<std::unique_ptr<LogReader>> segments;
+    for(const segment_info& segment : load_manifest(filename)) {
+        segments.push_back(std::make_unique<LogReader>(segment_filename(filename, segment.number)));
+    }
+    segments.push_back(std::make_unique<LogReader>(filename));
+    tail_reply reply = {};
+    size_t first_segment = 0;
+    size_t first = 0;
+    if(!request.has_messages) {
+        reply.found = true;
+    } else {
+        // Newest first, since the requester is usually only a little behind
+        for(size_t segment = segments.size(); segment-- > 0;) {
+            const LogReader& log = *segments[segment];
+            if(!log.valid() || log.size() == 0) {
+                continue;
+            }
+            size_t latest = log.find(request.view_id, request.sender, request.index);
+            if(latest != log.size()) {
+                reply.found = true;
+                first_segment = segment;
+                first = latest + 1;
+                break;
+            }
+        }
+    }
+    if(reply.found) {
+        for(size_t segment = first_segment; segment < segments.size(); ++segment) {
+            const LogReader& log = *segments[segment];
+            // A sealed segment that can't be read would leave a gap in the
+            // tail; the current one may just not have been created yet
+            if(!log.valid()) {
+                if(segment + 1 < segments.size()) {
+                    std::cerr << "WARNING: cannot serve the tail of " << filename
+                              << ": one of its sealed segments is unreadable" << std::endl;
+                    reply.found = false;
+                    break;
+                }
+                continue;
+            }
+            reply.num_records += log.size() - (segment == first_segment ? first : 0);
+        }
+    }
+    if(!socket.write((char*)&reply, sizeof(reply)) || !reply.found) {
+        return;
+    }
+    for(size_t segment = first_segment; segment < segments.size(); ++segment) {
+        if(segments[segment]->valid()
+           && !send_records(socket, *segments[segment], segment == first_segment ? first : 0,
+                            filename)) {
+            return;
+        }
+    }
+}
+
+std::vector<peer_log_state> query_peers(const std::map<uint32_t, std::string>& peer_ips,
+                                        uint32_t port) {
+    std::vector<peer_log_state> states(peer_ips.size());
+    std::vector<char> responded(peer_ips.size(), false);
+    std::vector<std::thread> threads;
+    size_t peer_num = 0;
+    for(const auto& peer : peer_ips) {
+        threads.emplace_back([&states, &responded, peer_num, peer, port]() {
+            try {
+                tcp::socket socket(peer.second, port);
+                recovery_request request = {};
+                request.type = RECOVERY_STATE;
+                state_reply reply;
+                if(!socket.write((char*)&request, sizeof(request))
+                   || !socket.read((char*)&reply, sizeof(reply))) {
+                    return;
+                }
+                peer_log_state& state = states[peer_num];
+                state.node_id = peer.first;
+                state.has_messages = reply.has_messages;
+                state.latest = reply.latest;
+                state.view_file.resize(reply.view_file_size);
+                if(reply.view_file_size > 0
+                   && !socket.read(state.view_file.data(), reply.view_file_size)) {
+                    return;
+                }
+                responded[peer_num] = true;
+            } catch(tcp::exception&) {
+            }
+        });
+        peer_num++;
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    std::vector<peer_log_state> responses;
+    for(size_t i = 0; i < states.size(); ++i) {
+        if(responded[i]) {
+            responses.push_back(std::move(states[i]));
+        }
+    }
+    return responses;
+}
+
+long long int fetch_log_tail(const std::string& peer_ip, uint32_t port,
+                             const std::string& filename, bool has_messages,
+                             const message_metadata& local_latest) {
+    try {
+        tcp::socket socket(peer_ip, port);
+        recovery_request request = {};
+        request.type = RECOVERY_TAIL;
+        request.has_messages = has_messages;
+        request.view_id = local_latest.view_id;
+        request.sender = local_latest.sender;
+        request.index = local_latest.index;
+        tail_reply reply;
+        if(!socket.write((char*)&request, sizeof(request))
+           || !socket.read((char*)&reply, sizeof(reply))) {
+            return -1;
+        }
+        if(!reply.found) {
+            std::cerr << "WARNING: node at " << peer_ip << " does not have this node's latest "
+                      << "message in its log" << std::endl;
+            return -1;
+        }
+
+        std::mutex written_mutex;
+        std::condition_variable written_cv;
+        uint64_t num_written = 0;
+        std::vector<char> buffer;
+        FileWriter writer([&](const std::vector<message>& written) {
+            {
+                std::lock_guard<std::mutex> lock(written_mutex);
+                num_written += written.size();
+            }
+            written_cv.notify_all();
+        }, filename);
+
+        uint64_t num_appended = 0;
+        while(num_appended < reply.num_records) {
+            chunk_header header;
+            if(!socket.read((char*)&header, sizeof(header))) {
+                return -1;
+            }
+            size_t records_size = header.num_records * sizeof(message_metadata);
+            buffer.resize(records_size + header.data_size);
+            if(!socket.read(buffer.data(), buffer.size())) {
+                return -1;
+            }
+            if(crc32c(0, buffer.data(), buffer.size()) != header.checksum) {
+                std::cerr << "WARNING: log tail from " << peer_ip << " failed its checksum" << std::endl;
+                return -1;
+            }
+            const message_metadata* records = (const message_metadata*)buffer.data();
+            char* data = buffer.data() + records_size;
+            for(uint32_t i = 0; i < header.num_records; ++i) {
+                // FileWriter assigns each message its offset in the local log
+                writer.write_message(message{data, records[i].length, records[i].view_id,
+                                             records[i].sender, records[i].index,
+                                             (bool)records[i].is_cooked, records[i].sender_rank});
+                data += records[i].length;
+            }
+            num_appended += header.num_records;
+            // The FileWriter writes from buffer, so it can't be reused until
+            // this chunk is on disk
+            std::unique_lock<std::mutex> lock(written_mutex);
+            written_cv.wait(lock, [&]() { return num_written == num_appended; });
+        }
+        return num_appended;
+    } catch(tcp::exception&) {
+        return -1;
+    }
+}
+
+bool replay_log(const LogReader& log, size_t first_record, size_t last_record,
+                const std::function<void(const message_metadata&, char*)>& replay) {
+    std::vector<char> buffer;
+    size_t start = first_record;
+    while(start < last_record) {
+        // Read up to REPLAY_READ_SIZE bytes of messages at a time
+        size_t end = start;
+        uint64_t size = 0;
+        do {
+            size += log[end].length;
+            end++;
+        } while(end < last_record && size + log[end].length <= REPLAY_READ_SIZE);
+        buffer.resize(size);
+        if(!read_records_data(log, start, end, buffer.data())) {
+            return false;
+        }
+        char* data = buffer.data();
+        for(size_t record = start; record < end; ++record) {
+            replay(log[record], data);
+            data += log[record].length;
+        }
+        start = end;
+    }
+    return true;
+}
+
+}  // namespace derecho
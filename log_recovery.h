@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log_reader.h"
+#include "persistence.h"
+#include "rdmc/connection.h"
+
+namespace derecho {
+
+/** What a node reported about its persistent log during recovery. */
+struct peer_log_state {
+    uint32_t node_id;
+    bool has_messages = false;
+    /** The latest message in the node's log, if has_messages. */
+    persistence::message_metadata latest{};
+    /** The contents of the node's saved view file, as written by
+     * persist_view, or empty if it has none. */
+    std::vector<char> view_file;
+};
+
+/**
+ * Answers other nodes' recovery requests for this node's saved view, latest
+ * logged message and log tail, on its own port. Every node with a persistent
+ * log runs one, so that a restarting node can recover from live members as
+ * well as from members that are restarting at the same time.
+ */
+class LogRecoveryServer {
+    const std::string filename;
+    const uint32_t port;
+    tcp::connection_listener listener;
+    std::atomic<bool> shutdown;
+    /** A thread serving one request, which sets done when it finishes. */
+    struct connection_thread {
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+    std::mutex connection_threads_mutex;
+    std::list<connection_thread> connection_threads;
+    std::thread listener_thread;
+
+    void serve(tcp::socket socket);
+    /** Joins and removes the connection threads that have finished. Must be
+     * called with connection_threads_mutex held. */
+    void reap_connection_threads();
+
+public:
+    LogRecoveryServer(const std::string& filename, uint32_t port);
+    ~LogRecoveryServer();
+};
+
+/**
+ * Asks every node in peer_ips (node ID to IP address) for its log state,
+ * with one connection per node in parallel.
+ * @return the states of the nodes that responded
+ */
+std::vector<peer_log_state> query_peers(const std::map<uint32_t, std::string>& peer_ips,
+                                        uint32_t port);
+
+/**
+ * Fetches the messages after local_latest (or all of them, if the local log
+ * has no messages) from a peer's log, in chunks whose CRC32C is checked, and
+ * appends them to the local log called filename. The peer serves them from
+ * whichever of its segments, sealed or current, hold them, so this only
+ * fails for want of messages if local_latest is older than every segment
+ * the peer still keeps.
+ * @return the number of messages appended, or -1 if the fetch failed
+ */
+long long int fetch_log_tail(const std::string& peer_ip, uint32_t port,
+                             const std::string& filename, bool has_messages,
+                             const persistence::message_metadata& local_latest);
+
+/** Calls replay for records first_record up to (not including) last_record
+ * of log, in order, with each message's data. */
+bool replay_log(const LogReader& log, size_t first_record, size_t last_record,
+                const std::function<void(const persistence::message_metadata&, char*)>& replay);
+
+}  // namespace derecho
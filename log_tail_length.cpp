@@ -7,18 +7,19 @@
  */
 
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <cstdlib>
 #include <cstdint>
+#include <cstring>
+#include <tuple>
 
-#include "persistence.h"
-#include "serialization/SerializationSupport.hpp"
+#include "log_manifest.h"
+#include "log_reader.h"
 
 using namespace derecho::persistence;
 
 int main(int argc, char* argv[]) {
-    if(argc < 4) {
+    if(argc < 5) {
         std::cout << "Usage: log_tail_length [-m] <filename> <vid> <sender> <index>" << std::endl;
         return 1;
     }
@@ -27,51 +28,54 @@ int main(int argc, char* argv[]) {
     if(strcmp(argv[1], "-m") == 0) {
         print_metadata = true;
         trailing_args_start = 2;
+        if(argc < 6) {
+            std::cout << "Usage: log_tail_length [-m] <filename> <vid> <sender> <index>" << std::endl;
+            return 1;
+        }
     }
     std::string filename(argv[trailing_args_start]);
     uint32_t target_vid = std::atoi(argv[trailing_args_start + 1]);
     uint32_t target_sender = std::atoi(argv[trailing_args_start + 2]);
     uint64_t target_index = std::atol(argv[trailing_args_start + 3]);
 
-    uint64_t target_offset = 0;
-    uint64_t target_size = 0;
-    std::ifstream metadata_file(filename + METADATA_EXTENSION, std::ios::binary);
-    message_metadata dummy_for_size;
-    std::size_t size_of_metadata = mutils::bytes_size(dummy_for_size);
-    char buffer[size_of_metadata];
-    //Read the header to get past it
-    header file_header;
-    metadata_file.read((char*)&file_header, sizeof(file_header));
-    //Scan through the metadata blocks until we find the one with the right sequence number
-    uint32_t vid = 0, sender = 0;
-    uint64_t index = 0;
-    while(!(vid == target_vid && sender == target_sender && index == target_index) && metadata_file) {
-        metadata_file.read(buffer, size_of_metadata);
-        auto metadata = mutils::from_bytes<message_metadata>(nullptr, buffer);
-        vid = metadata->view_id;
-        sender = metadata->sender;
-        index = metadata->index;
-        if(print_metadata) {
-            target_offset = metadata_file.tellg();
-        } else {
-            target_offset = metadata->offset;
-            target_size = metadata->length;
+    derecho::LogReader log(filename);
+    if(!log.valid()) {
+        std::cerr << "Could not read the metadata of " << filename << std::endl;
+        return 1;
+    }
+    //Look up the target message with the index, instead of scanning the log
+    std::size_t record = log.find(target_vid, target_sender, target_index);
+    if(record == log.size()) {
+        //The tail is measured within the current segment, which is the one
+        //recovery appends to
+        for(const segment_info& segment : load_manifest(filename)) {
+            auto target = std::make_tuple(target_vid, target_index);
+            if(target < std::make_tuple(segment.first_view_id, segment.first_index)
+               || target > std::make_tuple(segment.last_view_id, segment.last_index)) {
+                continue;
+            }
+            derecho::LogReader sealed(segment_filename(filename, segment.number));
+            if(sealed.valid() && sealed.find(target_vid, target_sender, target_index) != sealed.size()) {
+                std::cerr << "Message " << target_vid << " " << target_sender << " " << target_index
+                          << " is in sealed segment " << segment.number
+                          << ", not the current segment of " << filename << std::endl;
+                return 1;
+            }
         }
+        std::cerr << "Message " << target_vid << " " << target_sender << " "
+                  << target_index << " is not in " << filename << std::endl;
+        return 1;
     }
-    //Get the size of the whole file, so we can subtract from it
-    std::streamoff file_size = 0;
+
+    uint64_t end_of_target;
+    uint64_t file_size;
     if(print_metadata) {
-        metadata_file.seekg(0, std::ios::end);
-        file_size = metadata_file.tellg();
-        target_size = size_of_metadata;
+        end_of_target = derecho::LogReader::metadata_offset(record + 1);
+        file_size = log.metadata_file_size();
     } else {
-        std::ifstream logfile(filename, std::ios::binary);
-        logfile.seekg(0, std::ios::end);
-        file_size = logfile.tellg();
+        end_of_target = log[record].offset + log[record].length;
+        file_size = log.data_file_size();
     }
-
-    auto endoftarget = target_offset + target_size;
-    auto distance = file_size - endoftarget;
-    std::cout << distance << std::endl;
+    std::cout << file_size - end_of_target << std::endl;
     return 0;
 }
@@ -11,6 +11,7 @@
 #include <utility>
 #include <vector>
 
+#include "log_recovery.h"
 #include "logger.h"
 #include "rdmc/connection.h"
 #include "view.h"
@@ -120,6 +121,9 @@ private:
     std::vector<view_upcall_t> view_upcalls;
 
     DerechoParams derecho_params;
+    /** Answers other members' log recovery requests, if this node has a
+     * persistent log. */
+    std::unique_ptr<LogRecoveryServer> recovery_server;
     /** Sends a joining node the new view that has been constructed to include it.*/
     void commit_join(const View<dispatcherType>& new_view,
                      tcp::socket& client_socket);
@@ -133,6 +137,13 @@ private:
   std::unique_ptr<View<dispatcherType>> start_group(const node_id_t my_id, const ip_addr my_ip);
     /** Joins an existing Derecho group, initializing this object to participate in its GMS. */
   std::unique_ptr<View<dispatcherType>> join_existing(const node_id_t my_id, const ip_addr& leader_ip, const int leader_port);
+    /** Brings the local view file and log up to date from the members of
+     * last_view, replaying the log to the application, and returns the
+     * latest view found. */
+    std::unique_ptr<View<dispatcherType>> recover_from_members(const std::string& recovery_filename,
+                                                               const node_id_t my_id,
+                                                               std::unique_ptr<View<dispatcherType>> last_view,
+                                                               const CallbackSet& callbacks);
 
     // Ken's helper methods
     void deliver_in_order(const View<dispatcherType>& Vc, int Leader);
@@ -152,8 +163,7 @@ private:
 
     /** Creates the SST and derecho_group for the current view, using the current view's member list.
      * The parameters are all the possible parameters for constructing derecho_group. */
-    void setup_derecho(std::vector<MessageBuffer>& message_buffers,
-		       CallbackSet callbacks,
+    void setup_derecho(CallbackSet callbacks,
                        const DerechoParams& derecho_params);
     /** Sets up the SST and derecho_group for a new view, based on the settings in the current view
      * (and copying over the SST data from the current view). */
@@ -189,13 +199,12 @@ public:
                  const int gms_port = 12345);
     /**
      * Constructor that re-starts a failed group member from log files.
-     * It assumes the local ".paxosstate" file already contains the last known
-     * view, obtained from a quorum of members, and that any messages missing
-     * from the local log have already been appended from the longest log of a
-     * member of the last known view. (This can be accomplished by running the
-     * script log_recovery_helper.sh). Does NOT currently attempt to replay
-     * completion events for missing messages that were transferred over from
-     * another member's log.
+     * It first contacts the members of the last known view (from the local
+     * ".paxosstate" file) in parallel, until a quorum has responded, adopting
+     * any newer view they have. Messages missing from the local log are then
+     * fetched from the member with the longest log and appended to it, while
+     * the local log is replayed to callbacks.log_replay_callback; the fetched
+     * messages are replayed after it.
      * The last 5 parameters are the callbacks and DerechoGroup parameters
      * to use for sending messages once recovery is complete.
      * @param recovery_filename The base name of the set of recovery files to
@@ -231,6 +240,12 @@ public:
      * buffer. (Analogous to DerechoGroup::get_position) */
     char* get_sendbuffer_ptr(long long unsigned int payload_size,
                              int pause_sending_turns = 0, bool cooked_send = false);
+    /** Like get_sendbuffer_ptr, but waits up to timeout for there to be room,
+     * in this view or the ones after it, rather than returning nullptr right
+     * away. (Analogous to DerechoGroup::get_position_for) */
+    char* get_sendbuffer_ptr_for(std::chrono::nanoseconds timeout,
+                                 long long unsigned int payload_size,
+                                 int pause_sending_turns = 0, bool cooked_send = false);
     /** Instructs the managed DerechoGroup to send the next message. This
      * returns immediately; the send is scheduled to happen some time in the future. */
     void send();
@@ -250,6 +265,14 @@ public:
     void report_failure(const node_id_t who);
     /** Waits until all members of the group have called this function. */
     void barrier_sync();
+    /** Deletes the persistent log segments covered by an application
+     * checkpoint. (Analogous to DerechoGroup::truncate_log) */
+    uint64_t truncate_log(long long int checkpoint_seq_num);
+    /** How long this node's sends have been held back by the delivery and
+     * the persistence windows. (Analogous to DerechoGroup::get_send_stall_stats) */
+    send_stall_stats get_send_stall_stats();
+    /** This node's current window. (Analogous to DerechoGroup::get_window_stats) */
+    window_stats get_window_stats();
     void debug_print_status() const;
     static void log_event(const std::string& event_text) {
         util::debug_log().log_event(event_text);
@@ -18,6 +18,8 @@
 #include <signal.h>
 #include <sstream>
 #include <stdexcept>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #include "managed_group.h"
@@ -52,6 +54,8 @@ ManagedGroup<dispatcherType>::ManagedGroup(
       view_upcalls(_view_upcalls),
       derecho_params(derecho_params) {
     const node_id_t my_id = 0;
+    // The parameters this group runs with, and sends to joining members
+    this->derecho_params.session_token = new_session_token();
     curr_view = start_group(my_id, my_ip);
     rdmc_sst_setup();
     tcp::socket client_socket = server_socket.accept();
@@ -70,11 +74,13 @@ ManagedGroup<dispatcherType>::ManagedGroup(
    std::size_t size_of_view = mutils::bytes_size(*curr_view);
    client_socket.write((char*)&size_of_view, sizeof(size_of_view));
    mutils::post_object(bind_socket_write, *curr_view);
-   std::size_t size_of_derecho_params = mutils::bytes_size(derecho_params);
+   std::size_t size_of_derecho_params = mutils::bytes_size(this->derecho_params);
    client_socket.write((char*)&size_of_derecho_params, sizeof(size_of_derecho_params));
-   mutils::post_object(bind_socket_write, derecho_params);
+   mutils::post_object(bind_socket_write, this->derecho_params);
    dispatchers.send_objects(client_socket);
-   rdma::impl::verbs_add_connection(client_id, joiner_ip, my_id);
+   if(derecho_params.transport == RDMC_TRANSPORT) {
+       rdma::impl::verbs_add_connection(client_id, joiner_ip, my_id);
+   }
    sst::add_node(client_id, joiner_ip);
 
    if(!derecho_params.filename.empty()) {
@@ -82,15 +88,9 @@ ManagedGroup<dispatcherType>::ManagedGroup(
        persist_view(*curr_view, view_file_name);
    }
 
-   std::vector<MessageBuffer> message_buffers;
-   auto max_msg_size = DerechoGroup<MAX_MEMBERS, dispatcherType>::compute_max_msg_size(derecho_params.max_payload_size, derecho_params.block_size);
-   while(message_buffers.size() < derecho_params.window_size * MAX_MEMBERS) {
-       message_buffers.emplace_back(max_msg_size);
-   }
-
    log_event("Initializing SST and RDMC for the first time.");
-   setup_derecho(message_buffers, callbacks, derecho_params);
-   curr_view->gmsSST->put();
+   setup_derecho(callbacks, this->derecho_params);
+   gmssst::put_used(*curr_view->gmsSST);
    curr_view->gmsSST->sync_with_members();
    log_event("Done setting up initial SST and RDMC");
 
@@ -143,13 +143,8 @@ ManagedGroup<dispatcherType>::ManagedGroup(const node_id_t my_id,
     }
     log_event("Initializing SST and RDMC for the first time.");
 
-    std::vector<MessageBuffer> message_buffers;
-    auto max_msg_size = DerechoGroup<MAX_MEMBERS, dispatcherType>::compute_max_msg_size(derecho_params.max_payload_size, derecho_params.block_size);
-    while(message_buffers.size() < derecho_params.window_size * MAX_MEMBERS) {
-        message_buffers.emplace_back(max_msg_size);
-    }
-    setup_derecho(message_buffers, callbacks, derecho_params);
-    curr_view->gmsSST->put();
+    setup_derecho(callbacks, derecho_params);
+    gmssst::put_used(*curr_view->gmsSST);
     curr_view->gmsSST->sync_with_members();
     log_event("Done setting up initial SST and RDMC");
 
@@ -159,7 +154,7 @@ ManagedGroup<dispatcherType>::ManagedGroup(const node_id_t my_id,
         gmssst::init_from_existing(
             (*curr_view->gmsSST)[curr_view->my_rank],
             (*curr_view->gmsSST)[curr_view->rank_of_leader()]);
-        curr_view->gmsSST->put();
+        gmssst::put_used(*curr_view->gmsSST);
         log_event("Joining node initialized its SST row from the leader");
     }
 
@@ -204,15 +199,12 @@ ManagedGroup<dispatcherType>::ManagedGroup(const std::string& recovery_filename,
       dispatchers(std::move(_dispatchers)),
       view_upcalls(_view_upcalls),
       derecho_params(derecho_params) {
-    auto last_view = load_view<dispatcherType>(view_file_name);    
-    std::vector<MessageBuffer> message_buffers;
-    auto max_msg_size = DerechoGroup<MAX_MEMBERS, dispatcherType>::compute_max_msg_size(derecho_params.max_payload_size, derecho_params.block_size);
-    while(message_buffers.size() < derecho_params.window_size * MAX_MEMBERS) {
-        message_buffers.emplace_back(max_msg_size);
-    }
-
+    auto last_view = recover_from_members(recovery_filename, my_id,
+                                          load_view<dispatcherType>(view_file_name), callbacks);
     if(my_id != last_view->members[last_view->rank_of_leader()]) {
-        curr_view = join_existing(my_id, last_view->member_ips[last_view->rank_of_leader()], gms_port, derecho_params);
+        curr_view = join_existing(my_id, last_view->member_ips[last_view->rank_of_leader()], gms_port);
+        // Run in the leader's session
+        derecho_params.session_token = this->derecho_params.session_token;
     } else {
         /* This should only happen if an entire group failed and the leader is restarting;
          * otherwise the view obtained from the recovery script will have a leader that is
@@ -220,6 +212,8 @@ ManagedGroup<dispatcherType>::ManagedGroup(const std::string& recovery_filename,
          * restart and join. */
         curr_view = start_group(my_id, my_ip);
         curr_view->vid = last_view->vid + 1;
+        derecho_params.session_token = new_session_token();
+        this->derecho_params.session_token = derecho_params.session_token;
         tcp::socket client_socket = server_socket.accept();
         node_id_t client_id = 0;
         client_socket.exchange(my_id, client_id);
@@ -244,10 +238,9 @@ ManagedGroup<dispatcherType>::ManagedGroup(const std::string& recovery_filename,
     
     log_event("Initializing SST and RDMC for the first time.");
     derecho_params.filename = recovery_filename;
-    setup_derecho(message_buffers,
-                  callbacks,
+    setup_derecho(callbacks,
                   derecho_params);
-    curr_view->gmsSST->put();
+    gmssst::put_used(*curr_view->gmsSST);
     curr_view->gmsSST->sync_with_members();
     log_event("Done setting up initial SST and RDMC");
     //Initialize nChanges and nAcked in the local SST row to the saved view's VID, so the next proposed change is detected
@@ -281,10 +274,16 @@ void ManagedGroup<dispatcherType>::rdmc_sst_setup() {
     cout << "Doing global setup of RDMC and SST" << endl;
     // construct member_ips
     auto member_ips_map = get_member_ips_map(curr_view->members, curr_view->member_ips, curr_view->failed);
-    if(!rdmc::initialize(member_ips_map, curr_view->members[curr_view->my_rank])) {
+    // Only RDMC needs connections of its own; the other transports make
+    // theirs when DerechoGroup creates them
+    if(derecho_params.transport == RDMC_TRANSPORT
+       && !rdmc::initialize(member_ips_map, curr_view->members[curr_view->my_rank])) {
         cout << "Global setup failed" << endl;
         exit(0);
     }
+    // The SST, which the GMS and the ordering protocol run on, always uses
+    // RDMA verbs: whatever the transport, every member still needs an RDMA
+    // NIC, and only message bodies avoid it.
     sst::verbs_initialize(member_ips_map, curr_view->members[curr_view->my_rank]);
 }
 
@@ -352,7 +351,7 @@ void ManagedGroup<dispatcherType>::register_predicates() {
                     throw derecho_exception("Potential partitioning event: this node is no longer in the majority and must shut down!");
                 }
 
-                gmsSST.put();
+                gmssst::put_used(gmsSST);
                 if(Vc.IAmLeader() && !changes_contains(gmsSST, Vc.members[q]))  // Leader initiated
                 {
                     if((gmsSST[myRank].nChanges - gmsSST[myRank].nCommitted) == MAX_MEMBERS) {
@@ -362,7 +361,7 @@ void ManagedGroup<dispatcherType>::register_predicates() {
                     gmssst::set(gmsSST[myRank].changes[gmsSST[myRank].nChanges % MAX_MEMBERS], Vc.members[q]);  // Reports the failure (note that q NotIn members)
                     gmssst::increment(gmsSST[myRank].nChanges);
                     log_event(std::stringstream() << "Leader proposed a change to remove failed node " << Vc.members[q]);
-                    gmsSST.put();
+                    gmssst::put_used(gmsSST);
                 }
             }
         }
@@ -390,7 +389,7 @@ void ManagedGroup<dispatcherType>::register_predicates() {
         gmssst::set(gmsSST[gmsSST.get_local_index()].nCommitted,
             min_acked(gmsSST, curr_view->failed));  // Leader commits a new request
         log_event(std::stringstream() << "Leader committing view proposal #" << gmsSST[gmsSST.get_local_index()].nCommitted);
-        gmsSST.put();
+        gmssst::put_used(gmsSST);
     };
 
     auto leader_proposed_change = [this](const DerechoSST& gmsSST) {
@@ -415,7 +414,7 @@ void ManagedGroup<dispatcherType>::register_predicates() {
 
         // Notice a new request, acknowledge it
         gmssst::set(gmsSST[myRank].nAcked, gmsSST[leader].nChanges);
-        gmsSST.put();
+        gmssst::put_used(gmsSST);
         log_event("Wedging current view.");
         curr_view->wedge();
         log_event("Done wedging current view.");
@@ -517,12 +516,14 @@ void ManagedGroup<dispatcherType>::register_predicates() {
                 log_event(std::stringstream() << "Starting creation of new SST and DerechoGroup for view " << next_view->vid);
 		// if  a new member has joined
 		if (curr_view->members.size() < next_view->members.size()) {
-		  rdma::impl::verbs_add_connection(next_view->members.back(), next_view->member_ips.back(), next_view->members[next_view->my_rank]);
+		  if(derecho_params.transport == RDMC_TRANSPORT) {
+		    rdma::impl::verbs_add_connection(next_view->members.back(), next_view->member_ips.back(), next_view->members[next_view->my_rank]);
+		  }
 		  sst::add_node(next_view->members.back(), next_view->member_ips.back());
 		}
                 // This will block until everyone responds to SST/RDMC initial handshakes
                 transition_sst_and_rdmc(*next_view, whoFailed);
-                next_view->gmsSST->put();
+                gmssst::put_used(*next_view->gmsSST);
                 next_view->gmsSST->sync_with_members();
                 log_event(std::stringstream() << "Done setting up SST and DerechoGroup for view " << next_view->vid);
                 // for view upcall
@@ -601,8 +602,7 @@ ManagedGroup<dispatcherType>::~ManagedGroup() {
 }
 
 template <typename dispatcherType>
-void ManagedGroup<dispatcherType>::setup_derecho(std::vector<MessageBuffer>& message_buffers,
-                                                 CallbackSet callbacks,
+void ManagedGroup<dispatcherType>::setup_derecho(CallbackSet callbacks,
                                                  const DerechoParams& derecho_params) {
     curr_view->gmsSST = std::make_shared<sst::SST<DerechoRow<MAX_MEMBERS>>>(
         curr_view->members, curr_view->members[curr_view->my_rank],
@@ -611,7 +611,14 @@ void ManagedGroup<dispatcherType>::setup_derecho(std::vector<MessageBuffer>& mes
         gmssst::init((*curr_view->gmsSST)[r]);
     }
     gmssst::set((*curr_view->gmsSST)[curr_view->my_rank].vid, curr_view->vid);
+    if(!derecho_params.filename.empty() && !recovery_server) {
+        recovery_server = std::make_unique<LogRecoveryServer>(derecho_params.filename,
+                                                              derecho_params.recovery_port);
+    }
 
+    // Enough buffers for the largest possible group; the pools only allocate
+    // (and register) them as views need them
+    auto message_buffers = DerechoGroup<MAX_MEMBERS, dispatcherType>::make_message_buffers(derecho_params);
     curr_view->derecho_group = std::make_unique<DerechoGroup<MAX_MEMBERS, dispatcherType>>(
         curr_view->members, curr_view->members[curr_view->my_rank],
         curr_view->gmsSST, message_buffers, std::move(dispatchers), callbacks, derecho_params,
@@ -697,6 +704,152 @@ std::unique_ptr<View<dispatcherType>> ManagedGroup<dispatcherType>::join_existin
     return newView;
 }
 
+template <typename dispatcherType>
+std::unique_ptr<View<dispatcherType>> ManagedGroup<dispatcherType>::recover_from_members(
+    const std::string& recovery_filename, const node_id_t my_id,
+    std::unique_ptr<View<dispatcherType>> last_view, const CallbackSet& callbacks) {
+    // The other members may be restarting too, and recovering from this one
+    recovery_server = std::make_unique<LogRecoveryServer>(recovery_filename,
+                                                          derecho_params.recovery_port);
+
+    // Open the local log before anything is appended to it, so that the
+    // local replay only covers the messages that were already logged
+    std::vector<std::unique_ptr<LogReader>> local_segments;
+    for(const auto& segment : persistence::load_manifest(recovery_filename)) {
+        local_segments.push_back(std::make_unique<LogReader>(
+            persistence::segment_filename(recovery_filename, segment.number)));
+    }
+    local_segments.push_back(std::make_unique<LogReader>(recovery_filename));
+    bool has_messages = false;
+    persistence::message_metadata local_latest{};
+    for(auto segment = local_segments.rbegin(); segment != local_segments.rend(); ++segment) {
+        if((*segment)->valid() && (*segment)->size() > 0) {
+            has_messages = true;
+            local_latest = (*segment)->latest();
+            break;
+        }
+    }
+    auto replay = [&callbacks](const persistence::message_metadata& metadata, char* data) {
+        callbacks.log_replay_callback(metadata.sender, metadata.index, data, metadata.length);
+    };
+    std::thread local_replay_thread([&]() {
+        if(!callbacks.log_replay_callback) {
+            return;
+        }
+        for(const auto& segment : local_segments) {
+            if(segment->valid()) {
+                replay_log(*segment, 0, segment->size(), replay);
+            }
+        }
+    });
+
+    // Like log_recovery_helper.sh did, wait for a quorum of the last known
+    // view to respond, and start over with any newer view one of them has
+    std::map<uint32_t, std::string> peer_ips;
+    std::vector<peer_log_state> peer_states;
+    while(true) {
+        peer_ips.clear();
+        for(int rank = 0; rank < last_view->num_members; ++rank) {
+            if(last_view->members[rank] != my_id) {
+                peer_ips[last_view->members[rank]] = last_view->member_ips[rank];
+            }
+        }
+        peer_states = query_peers(peer_ips, derecho_params.recovery_port);
+        bool found_newer_view = false;
+        for(const auto& state : peer_states) {
+            // The view file holds the size of the view, then the view
+            if(state.view_file.size() <= sizeof(std::size_t)) {
+                continue;
+            }
+            auto view = mutils::from_bytes<View<dispatcherType>>(nullptr, state.view_file.data() + sizeof(std::size_t));
+            if(view->vid > last_view->vid) {
+                last_view = std::move(view);
+                found_newer_view = true;
+            }
+        }
+        if(found_newer_view) {
+            persist_view(*last_view, view_file_name);
+            continue;
+        }
+        if(peer_states.size() + 1 >= (size_t)last_view->num_members / 2 + 1) {
+            break;
+        }
+        log_event("Failed to reach a quorum of the last known view. Retrying after 5 seconds...");
+        std::this_thread::sleep_for(std::chrono::seconds(5));
+    }
+
+    // Messages are delivered (and logged) in order of vid, then index, then
+    // the sender's rank in that view
+    auto message_number = [](const persistence::message_metadata& metadata) {
+        return std::make_tuple(metadata.view_id, metadata.index, metadata.sender_rank);
+    };
+    // Fetch from the peer with the longest log, falling back to the next
+    // longest if it can't serve this node's tail (say, because it truncated
+    // the segment with this node's latest message); after a fetch from
+    // anyone but the longest, the longer logs are tried again from the new
+    // latest message. Recovery fails rather than carry on with a log that is
+    // missing messages a peer has.
+    size_t num_logged = 0;
+    {
+        LogReader log(recovery_filename);
+        num_logged = log.valid() ? log.size() : 0;
+    }
+    std::vector<const peer_log_state*> failed_peers;
+    while(true) {
+        std::vector<const peer_log_state*> newer_logs;
+        for(const auto& state : peer_states) {
+            if(state.has_messages
+               && (!has_messages || message_number(state.latest) > message_number(local_latest))
+               && std::find(failed_peers.begin(), failed_peers.end(), &state) == failed_peers.end()) {
+                newer_logs.push_back(&state);
+            }
+        }
+        if(newer_logs.empty()) {
+            break;
+        }
+        const peer_log_state* longest_log = *std::max_element(
+            newer_logs.begin(), newer_logs.end(),
+            [&](const peer_log_state* a, const peer_log_state* b) {
+                return message_number(a->latest) < message_number(b->latest);
+            });
+        std::stringstream event;
+        event << "Appending the tail of node " << longest_log->node_id << "'s log to the local log";
+        log_event(event);
+        long long int num_fetched = fetch_log_tail(peer_ips.at(longest_log->node_id),
+                                                   derecho_params.recovery_port,
+                                                   recovery_filename, has_messages, local_latest);
+        if(num_fetched < 0) {
+            std::cerr << "WARNING: failed to fetch the tail of node " << longest_log->node_id
+                      << "'s log" << std::endl;
+            failed_peers.push_back(longest_log);
+        } else {
+            failed_peers.clear();
+        }
+        // A failed fetch may still have appended part of the tail
+        LogReader log(recovery_filename);
+        if(log.valid() && log.size() > 0) {
+            has_messages = true;
+            local_latest = log.latest();
+        }
+    }
+    for(const auto& state : peer_states) {
+        if(state.has_messages
+           && (!has_messages || message_number(state.latest) > message_number(local_latest))) {
+            local_replay_thread.join();
+            throw derecho_exception("Could not fetch the messages node " + std::to_string(state.node_id)
+                                    + " logged after this node's latest one; not restarting with a stale log");
+        }
+    }
+    local_replay_thread.join();
+    if(callbacks.log_replay_callback) {
+        LogReader log(recovery_filename);
+        if(log.valid() && log.size() > num_logged) {
+            replay_log(log, num_logged, log.size(), replay);
+        }
+    }
+    return last_view;
+}
+
 template <typename dispatcherType>
 void ManagedGroup<dispatcherType>::receive_join(tcp::socket& client_socket) {
     ip_addr& joiner_ip = client_socket.remote_ip;
@@ -720,7 +873,7 @@ void ManagedGroup<dispatcherType>::receive_join(tcp::socket& client_socket) {
     log_event(std::stringstream() << "Wedging view " << curr_view->vid);
     curr_view->wedge();
     log_event("Leader done wedging view.");
-    gmsSST.put();
+    gmssst::put_used(gmsSST);
 }
 
 template <typename dispatcherType>
@@ -745,7 +898,7 @@ bool ManagedGroup<dispatcherType>::suspected_not_equal(
     const typename View<dispatcherType>::DerechoSST& gmsSST,
     const vector<bool>& old) {
     for(int r = 0; r < gmsSST.get_num_rows(); r++) {
-        for(int who = 0; who < MAX_MEMBERS; who++) {
+        for(int who = 0; who < gmsSST.get_num_rows(); who++) {
             if(gmsSST[r].suspected[who] && !old[who]) {
                 return true;
             }
@@ -849,7 +1002,7 @@ void ManagedGroup<dispatcherType>::leader_ragged_edge_cleanup(View<dispatcherTyp
 
     util::debug_log().log_event("Leader finished computing globalMin");
     gmssst::set((*Vc.gmsSST)[myRank].globalMinReady, true);
-    Vc.gmsSST->put();
+    gmssst::put_used(*Vc.gmsSST);
 
     deliver_in_order(Vc, Leader);
 }
@@ -863,7 +1016,7 @@ void ManagedGroup<dispatcherType>::follower_ragged_edge_cleanup(View<dispatcherT
     gmssst::set((*Vc.gmsSST)[myRank].globalMin, (*Vc.gmsSST)[Leader].globalMin,
                 Vc.num_members);
     gmssst::set((*Vc.gmsSST)[myRank].globalMinReady, true);
-    Vc.gmsSST->put();
+    gmssst::put_used(*Vc.gmsSST);
     deliver_in_order(Vc, Leader);
 }
 
@@ -876,7 +1029,7 @@ void ManagedGroup<dispatcherType>::report_failure(const node_id_t who) {
     cout << "Node ID " << who << " failure reported; marking suspected[" << r << "]" << endl;
     (*curr_view->gmsSST)[curr_view->my_rank].suspected[r] = true;
     int cnt = 0;
-    for(r = 0; r < MAX_MEMBERS; r++) {
+    for(r = 0; r < curr_view->num_members; r++) {
         if((*curr_view->gmsSST)[curr_view->my_rank].suspected[r]) {
             ++cnt;
         }
@@ -886,7 +1039,7 @@ void ManagedGroup<dispatcherType>::report_failure(const node_id_t who) {
         throw derecho_exception(
             "Potential partitioning event: this node is no longer in the majority and must shut down!");
     }
-    curr_view->gmsSST->put();
+    gmssst::put_used(*curr_view->gmsSST);
     std::cout << "Exiting from remote_failure" << std::endl;
 }
 
@@ -897,7 +1050,7 @@ void ManagedGroup<dispatcherType>::leave() {
     curr_view->derecho_group->wedge();
     curr_view->gmsSST->delete_all_predicates();
     (*curr_view->gmsSST)[curr_view->my_rank].suspected[curr_view->my_rank] = true;
-    curr_view->gmsSST->put();
+    gmssst::put_used(*curr_view->gmsSST);
     thread_shutdown = true;
 }
 
@@ -907,6 +1060,29 @@ char* ManagedGroup<dispatcherType>::get_sendbuffer_ptr(unsigned long long int pa
     return curr_view->derecho_group->get_position(payload_size, pause_sending_turns, cooked_send);
 }
 
+template <typename dispatcherType>
+char* ManagedGroup<dispatcherType>::get_sendbuffer_ptr_for(std::chrono::nanoseconds timeout,
+                                                          unsigned long long int payload_size,
+                                                          int pause_sending_turns, bool cooked_send) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock<std::mutex> lock(view_mutex);
+    while(true) {
+        auto group = curr_view->derecho_group.get();
+        // Releases view_mutex while it waits, so a view change can go ahead
+        char* buf = group->get_position_for(deadline - std::chrono::steady_clock::now(),
+                                            payload_size, pause_sending_turns, cooked_send, &lock);
+        if(buf || std::chrono::steady_clock::now() >= deadline) {
+            return buf;
+        }
+        // The view was wedged; try again in the next one
+        if(!view_change_cv.wait_until(lock, deadline, [&]() {
+               return curr_view->derecho_group.get() != group;
+           })) {
+            return nullptr;
+        }
+    }
+}
+
 template <typename dispatcherType>
 void ManagedGroup<dispatcherType>::send() {
     std::unique_lock<std::mutex> lock(view_mutex);
@@ -921,24 +1097,28 @@ template <typename IdClass, unsigned long long tag, typename... Args>
 void ManagedGroup<dispatcherType>::orderedSend(const vector<node_id_t>& nodes,
                                              Args&&... args) {
     char* buf;
-    while(!(buf = get_sendbuffer_ptr(0, 0, true))) {
+    while(!(buf = get_sendbuffer_ptr_for(std::chrono::seconds(1), 0, 0, true))) {
     };
 
     std::unique_lock<std::mutex> lock(view_mutex);
     curr_view->derecho_group->template orderedSend<IdClass, tag, Args...>(
         nodes, buf, std::forward<Args>(args)...);
+    lock.unlock();
+    send();
 }
 
 template <typename dispatcherType>
 template <typename IdClass, unsigned long long tag, typename... Args>
 void ManagedGroup<dispatcherType>::orderedSend(Args&&... args) {
     char* buf;
-    while(!(buf = get_sendbuffer_ptr(0, 0, true))) {
+    while(!(buf = get_sendbuffer_ptr_for(std::chrono::seconds(1), 0, 0, true))) {
     };
 
     std::unique_lock<std::mutex> lock(view_mutex);
     curr_view->derecho_group->template orderedSend<IdClass, tag, Args...>(buf,
                                                                                std::forward<Args>(args)...);
+    lock.unlock();
+    send();
 }
 
 template <typename dispatcherType>
@@ -946,24 +1126,30 @@ template <typename IdClass, unsigned long long tag, typename... Args>
 auto ManagedGroup<dispatcherType>::orderedQuery(const vector<node_id_t>& nodes,
                                               Args&&... args) {
     char* buf;
-    while(!(buf = get_sendbuffer_ptr(0, 0, true))) {
+    while(!(buf = get_sendbuffer_ptr_for(std::chrono::seconds(1), 0, 0, true))) {
     };
 
     std::unique_lock<std::mutex> lock(view_mutex);
-    return curr_view->derecho_group->template orderedQuery<IdClass, tag, Args...>(
+    auto results = curr_view->derecho_group->template orderedQuery<IdClass, tag, Args...>(
         nodes, buf, std::forward<Args>(args)...);
+    lock.unlock();
+    send();
+    return results;
 }
 
 template <typename dispatcherType>
 template <typename IdClass, unsigned long long tag, typename... Args>
 auto ManagedGroup<dispatcherType>::orderedQuery(Args&&... args) {
     char* buf;
-    while(!(buf = get_sendbuffer_ptr(0, 0, true))) {
+    while(!(buf = get_sendbuffer_ptr_for(std::chrono::seconds(1), 0, 0, true))) {
     };
 
     std::unique_lock<std::mutex> lock(view_mutex);
-    return curr_view->derecho_group->template orderedQuery<IdClass, tag, Args...>(buf,
-                                                                                       std::forward<Args>(args)...);
+    auto results = curr_view->derecho_group->template orderedQuery<IdClass, tag, Args...>(buf,
+                                                                                           std::forward<Args>(args)...);
+    lock.unlock();
+    send();
+    return results;
 }
 
 template <typename dispatcherType>
@@ -992,6 +1178,24 @@ void ManagedGroup<dispatcherType>::barrier_sync() {
     curr_view->gmsSST->sync_with_members();
 }
 
+template <typename dispatcherType>
+uint64_t ManagedGroup<dispatcherType>::truncate_log(long long int checkpoint_seq_num) {
+    lock_guard_t lock(view_mutex);
+    return curr_view->derecho_group->truncate_log(checkpoint_seq_num);
+}
+
+template <typename dispatcherType>
+send_stall_stats ManagedGroup<dispatcherType>::get_send_stall_stats() {
+    lock_guard_t lock(view_mutex);
+    return curr_view->derecho_group->get_send_stall_stats();
+}
+
+template <typename dispatcherType>
+window_stats ManagedGroup<dispatcherType>::get_window_stats() {
+    lock_guard_t lock(view_mutex);
+    return curr_view->derecho_group->get_window_stats();
+}
+
 template <typename dispatcherType>
 void ManagedGroup<dispatcherType>::debug_print_status() const {
     cout << "curr_view = " << curr_view->ToString() << endl;
@@ -0,0 +1,270 @@
+#include "message_buffer_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace derecho {
+
+namespace {
+
+const size_t HUGE_PAGE_SIZE = 2 << 20;
+/** MPOL_PREFERRED from <numaif.h>, which needs libnuma's headers. */
+const int MPOL_PREFERRED_POLICY = 1;
+
+size_t round_up(size_t size, size_t multiple) {
+    return (size + multiple - 1) / multiple * multiple;
+}
+
+/** The NUMA node of the first RDMA device, or -1 if there is none (or the
+ * machine isn't NUMA). */
+int nic_numa_node() {
+    DIR* devices = opendir("/sys/class/infiniband");
+    if(!devices) {
+        return -1;
+    }
+    int node = -1;
+    while(dirent* device = readdir(devices)) {
+        if(device->d_name[0] == '.') continue;
+        std::ifstream numa_node_file(std::string("/sys/class/infiniband/") + device->d_name + "/device/numa_node");
+        if(numa_node_file >> node) {
+            break;
+        }
+    }
+    closedir(devices);
+    return node;
+}
+
+/** Maps size bytes backed by huge pages if any are reserved, or else by
+ * normal pages with transparent huge pages requested. size is rounded up to
+ * the size actually mapped. */
+char* map_arena(size_t& size) {
+    size_t huge_size = round_up(size, HUGE_PAGE_SIZE);
+    void* memory = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(memory != MAP_FAILED) {
+        size = huge_size;
+        return (char*)memory;
+    }
+    memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    madvise(memory, size, MADV_HUGEPAGE);
+    return (char*)memory;
+}
+}  // namespace
+
+message_buffer_pool::message_buffer_pool(size_t buffer_size, bool register_memory, size_t max_buffers)
+    : buffer_size(round_up(std::max<size_t>(buffer_size, 1), sysconf(_SC_PAGESIZE))),
+      register_memory(register_memory),
+      max_buffers(max_buffers),
+      numa_node(register_memory ? nic_numa_node() : -1),
+      free_buffers(max_buffers) {}
+
+message_buffer_pool::~message_buffer_pool() {
+    // Buffers refer to the arenas, so they must go first
+    MessageBuffer buffer;
+    while(free_buffers.pop(buffer)) {
+    }
+    for(arena& a : arenas) {
+        a.mr.reset();
+        munmap(a.memory, a.size);
+    }
+}
+
+bool message_buffer_pool::add_arena(size_t count) {
+    count = std::min(count, max_buffers - total_buffers);
+    if(count == 0) {
+        return false;
+    }
+    size_t size = count * buffer_size;
+    char* memory = map_arena(size);
+    if(numa_node >= 0) {
+        // Before anything touches (and so places) the pages
+        unsigned long node_mask[4] = {};
+        if(numa_node < (int)(sizeof(node_mask) * 8)) {
+            node_mask[numa_node / 64] = 1ul << (numa_node % 64);
+            if(syscall(SYS_mbind, memory, size, MPOL_PREFERRED_POLICY,
+                       node_mask, sizeof(node_mask) * 8, 0) != 0) {
+                std::cerr << "WARNING: could not place message buffers on NUMA node "
+                          << numa_node << std::endl;
+            }
+        }
+    }
+    // Huge pages may leave room for more buffers than asked for
+    count = std::min(size / buffer_size, max_buffers - total_buffers);
+    std::shared_ptr<rdma::memory_region> mr;
+    if(register_memory) {
+        try {
+            mr = std::make_shared<rdma::memory_region>(memory, size);
+        } catch(...) {
+            munmap(memory, size);
+            throw;
+        }
+    }
+    arenas.push_back(arena{memory, size, mr});
+    for(size_t i = 0; i < count; ++i) {
+        free_buffers.push(MessageBuffer(memory + i * buffer_size, mr, mr ? i * buffer_size : 0, this));
+    }
+    total_buffers += count;
+    return true;
+}
+
+void message_buffer_pool::reserve(size_t count) {
+    std::lock_guard<std::mutex> lock(arenas_mutex);
+    if(total_buffers < count) {
+        add_arena(count - total_buffers);
+    }
+}
+
+bool message_buffer_pool::grow() {
+    std::lock_guard<std::mutex> lock(arenas_mutex);
+    // Double the pool, so a steady load settles after a few arenas
+    return add_arena(std::max<size_t>(total_buffers, 1));
+}
+
+bool message_buffer_pool::acquire(MessageBuffer& buffer) {
+    return free_buffers.pop(buffer);
+}
+
+void message_buffer_pool::release(MessageBuffer&& buffer) {
+    free_buffers.push(std::move(buffer));
+}
+
+void message_buffer_classes::add_class(size_t buffer_size, bool register_memory,
+                                       unsigned int buffers_per_member, size_t max_buffers) {
+    assert(classes.empty() || classes.back().pool->get_buffer_size() < buffer_size);
+    classes.push_back(size_class{std::make_unique<message_buffer_pool>(buffer_size, register_memory, max_buffers),
+                                 buffers_per_member});
+}
+
+size_t message_buffer_classes::get_max_buffer_size() const {
+    return classes.empty() ? 0 : classes.back().pool->get_buffer_size();
+}
+
+size_t message_buffer_classes::capacity() const {
+    size_t total = 0;
+    for(const size_class& c : classes) {
+        total += c.pool->capacity();
+    }
+    return total;
+}
+
+void message_buffer_classes::reserve(unsigned int num_members) {
+    for(size_class& c : classes) {
+        c.pool->reserve(c.buffers_per_member * num_members);
+    }
+}
+
+message_buffer_classes::~message_buffer_classes() {
+    {
+        std::lock_guard<std::mutex> lock(grow_mutex);
+        shutdown = true;
+    }
+    grow_cv.notify_all();
+    if(grower.joinable()) {
+        grower.join();
+    }
+}
+
+bool message_buffer_classes::pop(size_t size, MessageBuffer& buffer) {
+    for(size_class& c : classes) {
+        if(c.pool->get_buffer_size() >= size && c.pool->acquire(buffer)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool message_buffer_classes::acquire(size_t size, MessageBuffer& buffer) {
+    if(pop(size, buffer)) {
+        return true;
+    }
+    for(size_class& c : classes) {
+        if(c.pool->get_buffer_size() >= size) {
+            request_growth(c);
+            break;
+        }
+    }
+    return false;
+}
+
+void message_buffer_classes::release(MessageBuffer&& buffer) {
+    buffer.pool->release(std::move(buffer));
+}
+
+void message_buffer_classes::request_growth(size_class& c) {
+    std::lock_guard<std::mutex> lock(grow_mutex);
+    if(c.grow_requested || shutdown) {
+        return;
+    }
+    c.grow_requested = true;
+    if(!grower.joinable()) {
+        grower = std::thread(&message_buffer_classes::grow_loop, this);
+    }
+    grow_cv.notify_all();
+}
+
+void message_buffer_classes::grow_loop() {
+    std::unique_lock<std::mutex> lock(grow_mutex);
+    while(true) {
+        grow_cv.wait(lock, [this]() {
+            return shutdown || std::any_of(classes.begin(), classes.end(),
+                                           [](const size_class& c) { return c.grow_requested; });
+        });
+        if(shutdown) {
+            return;
+        }
+        bool grown = false;
+        for(size_class& c : classes) {
+            if(!c.grow_requested) {
+                continue;
+            }
+            // Mapping and registering memory is slow; don't hold up release
+            lock.unlock();
+            try {
+                grown = c.pool->grow() || grown;
+            } catch(std::exception& e) {
+                std::cerr << "WARNING: could not add message buffers of "
+                          << c.pool->get_buffer_size() << " bytes: " << e.what() << std::endl;
+            }
+            lock.lock();
+            c.grow_requested = false;
+        }
+        if(!grown) {
+            continue;
+        }
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> callback_lock(buffers_added_mutex);
+            if(buffers_added) {
+                buffers_added();
+            }
+        }
+        lock.lock();
+    }
+}
+
+void message_buffer_classes::set_buffers_added_callback(const void* owner,
+                                                        std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(buffers_added_mutex);
+    buffers_added_owner = owner;
+    buffers_added = std::move(callback);
+}
+
+void message_buffer_classes::clear_buffers_added_callback(const void* owner) {
+    std::lock_guard<std::mutex> lock(buffers_added_mutex);
+    if(buffers_added_owner == owner) {
+        buffers_added_owner = nullptr;
+        buffers_added = nullptr;
+    }
+}
+
+}  // namespace derecho
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "lockfree_queue.h"
+#include "rdmc/rdmc.h"
+
+namespace derecho {
+
+class message_buffer_pool;
+
+/**
+ * Represents a block of memory used to store a message. This object contains
+ * both the array of bytes in which the message is stored and the corresponding
+ * RDMA memory region (which has registered that array of bytes as part of its
+ * buffer, at offset). If the group's transport doesn't use RDMA, the buffer is
+ * not registered and mr is null. The buffer is page-aligned and a whole
+ * number of pages long.
+ * This is a move-only type, since memory regions can't be copied.
+ */
+struct MessageBuffer {
+    std::unique_ptr<char[], void (*)(void*)> buffer{nullptr, std::free};
+    std::shared_ptr<rdma::memory_region> mr;
+    /** The position of buffer within mr. */
+    size_t offset = 0;
+    /** The pool the buffer belongs to, if any. */
+    message_buffer_pool* pool = nullptr;
+
+    MessageBuffer() {}
+    /** Allocates (and registers) a buffer of its own. */
+    MessageBuffer(size_t size, bool register_memory = true) {
+        if(size != 0) {
+            // Whole pages, so that the FileWriter can write messages to disk
+            // with O_DIRECT straight from this memory
+            size_t page_size = sysconf(_SC_PAGESIZE);
+            size = (size + page_size - 1) / page_size * page_size;
+            void* memory;
+            if(posix_memalign(&memory, page_size, size) != 0) {
+                throw std::bad_alloc();
+            }
+            buffer.reset((char*)memory);
+            if(register_memory) {
+                mr = std::make_shared<rdma::memory_region>(buffer.get(), size);
+            }
+        }
+    }
+    /** Refers to memory owned by a message_buffer_pool. */
+    MessageBuffer(char* memory, std::shared_ptr<rdma::memory_region> mr, size_t offset,
+                  message_buffer_pool* pool)
+        : buffer(memory, [](void*) {}), mr(std::move(mr)), offset(offset), pool(pool) {}
+    MessageBuffer(const MessageBuffer&) = delete;
+    MessageBuffer(MessageBuffer&&) = default;
+    MessageBuffer& operator=(const MessageBuffer&) = delete;
+    MessageBuffer& operator=(MessageBuffer&&) = default;
+};
+
+/**
+ * The MessageBuffers of a ManagedGroup, shared by the DerechoGroups of all of
+ * its views. Buffers are carved out of a few large arenas, each registered
+ * with the NIC as a single memory region, backed by huge pages if the system
+ * has any reserved, and placed on the NIC's NUMA node. Acquiring and
+ * releasing a buffer is a pop from or push to a lock-free free list.
+ *
+ * Arenas are only added as buffers are needed: when a view needs more
+ * buffers in total (reserve), or when the free list has run dry (grow, which
+ * message_buffer_classes calls from a background thread). acquire never
+ * allocates. Buffers are never given back to the system, so the pool's size
+ * follows the largest number of buffers any view has needed, up to
+ * max_buffers.
+ */
+class message_buffer_pool {
+    struct arena {
+        char* memory;
+        size_t size;
+        std::shared_ptr<rdma::memory_region> mr;
+    };
+
+    const size_t buffer_size;
+    const bool register_memory;
+    const size_t max_buffers;
+    /** The NUMA node arenas are placed on, or -1 to leave it to the OS. */
+    const int numa_node;
+
+    /** Guards arenas and total_buffers, i.e. adding an arena. */
+    std::mutex arenas_mutex;
+    std::vector<arena> arenas;
+    size_t total_buffers = 0;
+    mpmc_queue<MessageBuffer> free_buffers;
+
+    /** Adds an arena of at least count buffers (capped at max_buffers in
+     * total); must hold arenas_mutex. */
+    bool add_arena(size_t count);
+
+public:
+    /**
+     * @param buffer_size the size of each buffer, which is rounded up to a
+     * whole number of pages
+     * @param register_memory whether buffers must be registered with the NIC
+     * @param max_buffers the most buffers the pool will ever hold
+     */
+    message_buffer_pool(size_t buffer_size, bool register_memory, size_t max_buffers);
+    ~message_buffer_pool();
+    message_buffer_pool(const message_buffer_pool&) = delete;
+    message_buffer_pool& operator=(const message_buffer_pool&) = delete;
+
+    size_t get_buffer_size() const { return buffer_size; }
+    size_t capacity() const { return max_buffers; }
+
+    /** Makes sure the pool holds at least count buffers (free or in use). */
+    void reserve(size_t count);
+    /** Adds an arena as large as the pool so far; returns false if the pool
+     * is already at max_buffers. May throw std::bad_alloc. */
+    bool grow();
+    /** Takes a free buffer; returns false if there are none. */
+    bool acquire(MessageBuffer& buffer);
+    /** Returns a buffer acquired from this pool. */
+    void release(MessageBuffer&& buffer);
+};
+
+/**
+ * Message buffers in several size classes, each a message_buffer_pool, so
+ * that a small message doesn't take up a buffer sized for the largest one.
+ * A buffer is taken from the smallest class the message fits in, or, if that
+ * class has run out, the next larger one that has a buffer free.
+ *
+ * A class that runs out is grown by a background thread, so that neither the
+ * sender nor the receive path ever maps or registers memory; when the thread
+ * has added buffers it calls the buffers-added callback, so that whoever was
+ * turned away can try again.
+ */
+class message_buffer_classes {
+    struct size_class {
+        std::unique_ptr<message_buffer_pool> pool;
+        /** How many buffers reserve sets aside per member. */
+        unsigned int buffers_per_member;
+        /** Set when the class has run out, until the grower has grown it. */
+        bool grow_requested = false;
+    };
+    /** Smallest buffers first. */
+    std::vector<size_class> classes;
+
+    /** Guards the grow_requested flags, shutdown and starting grower. */
+    std::mutex grow_mutex;
+    std::condition_variable grow_cv;
+    bool shutdown = false;
+    std::thread grower;
+
+    std::mutex buffers_added_mutex;
+    const void* buffers_added_owner = nullptr;
+    std::function<void()> buffers_added;
+
+    /** Takes a free buffer of at least size bytes without asking for any
+     * class to grow. */
+    bool pop(size_t size, MessageBuffer& buffer);
+    void request_growth(size_class& c);
+    void grow_loop();
+
+public:
+    message_buffer_classes() {}
+    ~message_buffer_classes();
+    message_buffer_classes(const message_buffer_classes&) = delete;
+    message_buffer_classes& operator=(const message_buffer_classes&) = delete;
+
+    /**
+     * Adds a class of buffers of buffer_size bytes (rounded up to whole
+     * pages); classes must be added in increasing order of size. The class
+     * holds at most max_buffers buffers.
+     */
+    void add_class(size_t buffer_size, bool register_memory,
+                   unsigned int buffers_per_member, size_t max_buffers);
+
+    /** The size of the largest buffers. */
+    size_t get_max_buffer_size() const;
+    /** The most buffers there can be, in all classes together. */
+    size_t capacity() const;
+
+    /** Makes sure every class holds its buffers_per_member for each of
+     * num_members members. */
+    void reserve(unsigned int num_members);
+    /** Takes a free buffer of at least size bytes; returns false if every
+     * class that is large enough has run out, in which case the smallest of
+     * them is grown in the background. */
+    bool acquire(size_t size, MessageBuffer& buffer);
+    /** Returns a buffer to the class it came from. */
+    void release(MessageBuffer&& buffer);
+
+    /** Sets the function the grower calls after adding buffers, replacing
+     * any other owner's. */
+    void set_buffers_added_callback(const void* owner, std::function<void()> callback);
+    /** Removes owner's callback, if it is still the one set, and waits for
+     * any call to it to return. */
+    void clear_buffers_added_callback(const void* owner);
+};
+
+}  // namespace derecho
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace derecho {
+
+/**
+ * A map from sequence numbers to values, stored as a circular array indexed
+ * by sequence number modulo its capacity. DerechoGroup only tracks messages
+ * within a window of sequence numbers, so once the array is large enough to
+ * hold that window, inserting and erasing never allocate, and finding a
+ * message is a single array access.
+ *
+ * If an insertion would make the range of sequence numbers held (from the
+ * lowest to the highest) larger than the capacity, the array is doubled until
+ * it fits. Erasing the lowest sequence number, as delivery does, is amortized
+ * constant time. T must be default-constructible and movable; erased values
+ * are reset to T() so that they release what they own.
+ */
+template <typename T>
+class message_ring {
+    struct slot {
+        bool occupied = false;
+        long long int seq = 0;
+        T value;
+    };
+
+    std::vector<slot> slots;
+    size_t count = 0;
+    /** The lowest and highest sequence numbers stored; valid if count > 0. */
+    long long int lowest = 0;
+    long long int highest = 0;
+
+    size_t index(long long int seq) const {
+        return (size_t)seq & (slots.size() - 1);
+    }
+
+    bool holds(long long int seq) const {
+        return slots[index(seq)].occupied;
+    }
+
+    void grow(size_t min_capacity) {
+        size_t capacity = std::max<size_t>(slots.size(), 1);
+        while(capacity < min_capacity) {
+            capacity *= 2;
+        }
+        if(capacity == slots.size()) {
+            return;
+        }
+        std::vector<slot> old_slots(capacity);
+        old_slots.swap(slots);
+        for(auto& s : old_slots) {
+            if(s.occupied) {
+                slots[index(s.seq)] = std::move(s);
+            }
+        }
+    }
+
+public:
+    message_ring(size_t capacity = 0) {
+        if(capacity) {
+            grow(capacity);
+        }
+    }
+    message_ring(const message_ring&) = delete;
+    message_ring& operator=(const message_ring&) = delete;
+    message_ring(message_ring&& other) { *this = std::move(other); }
+    /** Takes other's storage (and contents), leaving other empty. */
+    message_ring& operator=(message_ring&& other) {
+        slots = std::move(other.slots);
+        count = other.count;
+        lowest = other.lowest;
+        highest = other.highest;
+        other.slots.clear();
+        other.count = 0;
+        return *this;
+    }
+
+    /** Makes sure the ring can hold a range of capacity sequence numbers
+     * without growing. */
+    void reserve(size_t capacity) { grow(capacity); }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    /** Stores value under seq, replacing any value already stored there. */
+    T& insert(long long int seq, T&& value) {
+        long long int new_lowest = count ? std::min(lowest, seq) : seq;
+        long long int new_highest = count ? std::max(highest, seq) : seq;
+        if((size_t)(new_highest - new_lowest + 1) > slots.size()) {
+            grow(new_highest - new_lowest + 1);
+        }
+        slot& s = slots[index(seq)];
+        if(!s.occupied) {
+            count++;
+        }
+        s.occupied = true;
+        s.seq = seq;
+        s.value = std::move(value);
+        lowest = new_lowest;
+        highest = new_highest;
+        return s.value;
+    }
+
+    /** Returns the value stored under seq, or nullptr if there is none. */
+    T* find(long long int seq) {
+        if(count == 0 || seq < lowest || seq > highest || !holds(seq)) {
+            return nullptr;
+        }
+        return &slots[index(seq)].value;
+    }
+
+    void erase(long long int seq) {
+        slot& s = slots[index(seq)];
+        assert(s.occupied && s.seq == seq);
+        s.occupied = false;
+        s.value = T();
+        if(--count == 0) {
+            return;
+        }
+        if(seq == lowest) {
+            while(!holds(lowest)) {
+                lowest++;
+            }
+        } else if(seq == highest) {
+            while(!holds(highest)) {
+                highest--;
+            }
+        }
+    }
+
+    /** The lowest sequence number stored. The ring must not be empty. */
+    long long int first() const {
+        assert(count > 0);
+        return lowest;
+    }
+    /** The value stored under first(). */
+    T& front() {
+        assert(count > 0);
+        return slots[index(lowest)].value;
+    }
+
+    /** Calls f(seq, value) for every stored value, in sequence number order. */
+    template <typename F>
+    void for_each(F f) {
+        if(count == 0) {
+            return;
+        }
+        for(long long int seq = lowest; seq <= highest; ++seq) {
+            if(holds(seq)) {
+                f(seq, slots[index(seq)].value);
+            }
+        }
+    }
+
+    /** Erases everything, but keeps the storage for reuse. */
+    void clear() {
+        for(auto& s : slots) {
+            if(s.occupied) {
+                s.occupied = false;
+                s.value = T();
+            }
+        }
+        count = 0;
+    }
+};
+
+}  // namespace derecho
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <cstdint>
+#include "checksum.h"
 #include "derecho_row.h"
 
 namespace derecho {
@@ -15,8 +16,24 @@ struct message {
     uint32_t sender;
     uint64_t index;
     bool cooked;
+    /** The sender's rank in view view_id. */
+    uint16_t sender_rank = 0;
 };
 
+static const uint8_t MAGIC_NUMBER[8] = {'D', 'E', 'R', 'E', 'C', 'H', 'O', 29};
+
+/**
+ * Version 0 logs were written one metadata record at a time, starting at
+ * offset 0 of the data file on every restart. Version 1 logs have fixed-size
+ * metadata records in delivery order, so they are sorted by (view_id, index),
+ * with offsets continuing across restarts, and a sparse index file next to
+ * the metadata file. Version 2 logs also store a CRC32C of each record and
+ * its data in the record, so that a record torn by a crash can be detected.
+ * Version 3 logs also store the sender's rank in its view, which orders
+ * messages with the same (view_id, index).
+ */
+static const uint32_t LOG_FORMAT_VERSION = 3;
+
 struct __attribute__((__packed__)) header {
     uint8_t magic[8];
     uint32_t version;
@@ -26,16 +43,51 @@ struct __attribute__((__packed__)) message_metadata {
     uint32_t view_id;
     uint8_t is_cooked;
     uint8_t padding0;
-    uint16_t padding1;
+    /** The sender's rank in view view_id; 0 in logs older than version 3. */
+    uint16_t sender_rank;
     uint32_t sender;
-    uint32_t padding2;
+    /** See record_checksum; 0 in logs older than version 2. */
+    uint32_t checksum;
     uint64_t index;
 
     uint64_t offset;
     uint64_t length;
 };
 
+/** The CRC32C of a message's data followed by its metadata record, with the
+ * record's checksum field set to 0. */
+inline uint32_t record_checksum(message_metadata metadata, const char *data) {
+    metadata.checksum = 0;
+    return crc32c(crc32c(0, data, metadata.length), &metadata, sizeof(metadata));
+}
+
+/** The index file holds an index_entry for every INDEX_INTERVAL'th metadata
+ * record, followed by an index_trailer. */
+static const uint64_t INDEX_INTERVAL = 1024;
+
+/** The sort key of metadata record number record_number. */
+struct __attribute__((__packed__)) index_entry {
+    uint32_t view_id;
+    uint32_t padding0;
+    uint64_t index;
+    uint64_t record_number;
+};
+
+/**
+ * Rewritten after the last index_entry whenever the log grows. A trailer
+ * whose num_records doesn't match the metadata file (e.g. after a crash, or
+ * after recovery appended records from another node) is stale; the entries
+ * before it are still valid for the records they cover.
+ */
+struct __attribute__((__packed__)) index_trailer {
+    message_metadata last_record;
+    uint64_t num_records;
+    uint64_t num_entries;
+    uint8_t magic[8];
+};
+
 static const std::string METADATA_EXTENSION = ".metadata";
+static const std::string INDEX_EXTENSION = ".index";
 static const std::string PAXOS_STATE_EXTENSION = ".paxosstate";
 static const std::string SWAP_FILE_EXTENSION = ".swp";
 
@@ -0,0 +1,325 @@
+#include "shm_transport.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace derecho {
+
+namespace {
+/** ring_control::ready of an initialized segment; anything else (a fresh
+ * segment is zero-filled) means the sender isn't done with it yet. */
+const uint64_t SEGMENT_READY = 0x7368'6d72'696e'6721;
+}  // namespace
+
+constexpr std::chrono::seconds SharedMemoryTransport::SEGMENT_WAIT;
+constexpr unsigned int SharedMemoryTransport::IDLE_SPINS;
+constexpr std::chrono::microseconds SharedMemoryTransport::MIN_IDLE_SLEEP;
+constexpr std::chrono::microseconds SharedMemoryTransport::MAX_IDLE_SLEEP;
+
+char* SharedMemoryTransport::group_state::slot(uint64_t block_number) {
+    return segment + sizeof(ring_control) + slot_size * block_number;
+}
+
+SharedMemoryTransport::SharedMemoryTransport(uint32_t my_id, uint64_t session_token,
+                                             const std::string& name_prefix,
+                                             unsigned int ring_slots)
+    : my_id(my_id),
+      session_token(session_token),
+      name_prefix(name_prefix),
+      ring_slots(ring_slots),
+      worker_thread(&SharedMemoryTransport::work_loop, this) {
+    assert(ring_slots > 0);
+}
+
+SharedMemoryTransport::~SharedMemoryTransport() {
+    thread_shutdown = true;
+    wake_worker();
+    if(worker_thread.joinable()) {
+        worker_thread.join();
+    }
+    std::vector<uint16_t> group_numbers;
+    {
+        std::lock_guard<std::mutex> lock(groups_mutex);
+        for(const auto& p : groups) {
+            group_numbers.push_back(p.first);
+        }
+    }
+    for(auto group_number : group_numbers) {
+        destroy_group(group_number);
+    }
+}
+
+bool SharedMemoryTransport::create_group(uint16_t group_number, std::vector<uint32_t> members,
+                                         size_t block_size, rdmc::send_algorithm algorithm,
+                                         incoming_message_callback_t incoming_receive,
+                                         completion_callback_t send_callback,
+                                         failure_callback_t failure_callback) {
+    auto my_position = std::find(members.begin(), members.end(), my_id);
+    if(my_position == members.end() || members.size() - 1 > MAX_RING_READERS) {
+        return false;
+    }
+
+    auto group = std::make_shared<group_state>();
+    group->segment_name = "/" + name_prefix + "_" + std::to_string(session_token) + "_"
+                          + std::to_string(group_number) + "_" + std::to_string(members[0]);
+    group->block_size = block_size;
+    // Keep every slot cache-line aligned so neighbouring slots don't share lines
+    group->slot_size = ((sizeof(slot_header) + block_size + 63) / 64) * 64;
+    group->num_readers = members.size() - 1;
+    group->reader_index = std::distance(members.begin(), my_position) - 1;
+    group->segment_size = sizeof(ring_control) + group->slot_size * ring_slots;
+    group->incoming_receive = incoming_receive;
+    group->completion_callback = send_callback;
+
+    char* segment = group->reader_index < 0 ? create_segment(*group) : open_segment(*group);
+    if(!segment) {
+        std::cerr << "WARNING: could not set up shared memory segment " << group->segment_name << std::endl;
+        return false;
+    }
+    group->segment = segment;
+
+    std::lock_guard<std::mutex> lock(groups_mutex);
+    if(groups.count(group_number)) {
+        munmap(segment, group->segment_size);
+        if(group->reader_index < 0) {
+            shm_unlink(group->segment_name.c_str());
+        }
+        return false;
+    }
+    groups[group_number] = group;
+    wake_worker();
+    return true;
+}
+
+char* SharedMemoryTransport::create_segment(const group_state& group) {
+    // Anything already under this name is stale, and receivers only use
+    // the segment once it is marked ready below
+    shm_unlink(group.segment_name.c_str());
+    int fd = shm_open(group.segment_name.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if(fd < 0) {
+        return nullptr;
+    }
+    if(ftruncate(fd, group.segment_size) != 0) {
+        close(fd);
+        shm_unlink(group.segment_name.c_str());
+        return nullptr;
+    }
+    void* segment = mmap(nullptr, group.segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(segment == MAP_FAILED) {
+        shm_unlink(group.segment_name.c_str());
+        return nullptr;
+    }
+    ring_control* control = new(segment) ring_control;
+    control->blocks_written.value.store(0, std::memory_order_relaxed);
+    for(unsigned int i = 0; i < MAX_RING_READERS; ++i) {
+        control->blocks_read[i].value.store(0, std::memory_order_relaxed);
+    }
+    control->ready.value.store(SEGMENT_READY, std::memory_order_release);
+    return (char*)segment;
+}
+
+char* SharedMemoryTransport::open_segment(const group_state& group) {
+    auto deadline = std::chrono::steady_clock::now() + SEGMENT_WAIT;
+    while(std::chrono::steady_clock::now() < deadline && !thread_shutdown) {
+        int fd = shm_open(group.segment_name.c_str(), O_RDWR, 0);
+        if(fd >= 0) {
+            struct stat status;
+            void* segment = MAP_FAILED;
+            // The sender may not have sized it yet
+            if(fstat(fd, &status) == 0 && (size_t)status.st_size >= group.segment_size) {
+                segment = mmap(nullptr, group.segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            }
+            close(fd);
+            if(segment != MAP_FAILED) {
+                if(((ring_control*)segment)->ready.value.load(std::memory_order_acquire) == SEGMENT_READY) {
+                    return (char*)segment;
+                }
+                munmap(segment, group.segment_size);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return nullptr;
+}
+
+void SharedMemoryTransport::destroy_group(uint16_t group_number) {
+    std::shared_ptr<group_state> group;
+    {
+        std::lock_guard<std::mutex> lock(groups_mutex);
+        auto it = groups.find(group_number);
+        if(it == groups.end()) {
+            return;
+        }
+        group = std::move(it->second);
+        groups.erase(it);
+    }
+    // The worker thread may still be using its own reference to the group;
+    // wait for it to drop that reference before unmapping.
+    {
+        std::unique_lock<std::mutex> lock(worker_mutex);
+        released_cv.wait(lock, [&]() { return group.use_count() == 1; });
+    }
+    if(group->reader_index < 0) {
+        shm_unlink(group->segment_name.c_str());
+    }
+    munmap(group->segment, group->segment_size);
+}
+
+bool SharedMemoryTransport::send(uint16_t group_number, const transport_buffer& message,
+                                 size_t length) {
+    std::shared_ptr<group_state> group;
+    {
+        std::lock_guard<std::mutex> lock(groups_mutex);
+        auto it = groups.find(group_number);
+        if(it == groups.end()) {
+            return false;
+        }
+        group = it->second;
+    }
+    if(group->reader_index >= 0 || length == 0) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(group->sends_mutex);
+        group->sends.push_back(pending_send{message, length, 0});
+    }
+    wake_worker();
+    return true;
+}
+
+bool SharedMemoryTransport::make_send_progress(group_state& group) {
+    ring_control* control = group.control();
+    bool progress = false;
+    while(true) {
+        pending_send* current;
+        {
+            std::lock_guard<std::mutex> lock(group.sends_mutex);
+            if(group.sends.empty()) {
+                return progress;
+            }
+            current = &group.sends.front();
+        }
+
+        uint64_t written = control->blocks_written.value.load(std::memory_order_relaxed);
+        uint64_t slowest_reader = written;
+        for(unsigned int i = 0; i < group.num_readers; ++i) {
+            slowest_reader = std::min(slowest_reader,
+                                      control->blocks_read[i].value.load(std::memory_order_acquire));
+        }
+        if(written - slowest_reader >= ring_slots) {
+            return progress;
+        }
+
+        char* slot = group.slot(written % ring_slots);
+        slot_header* h = (slot_header*)slot;
+        h->message_length = current->length;
+        h->message_offset = current->bytes_written;
+        h->block_length = std::min(group.block_size, current->length - current->bytes_written);
+        memcpy(slot + sizeof(slot_header),
+               current->message.buffer + current->bytes_written, h->block_length);
+        current->bytes_written += h->block_length;
+        control->blocks_written.value.store(written + 1, std::memory_order_release);
+        progress = true;
+
+        if(current->bytes_written == current->length) {
+            // The message has been copied out of the sender's buffer, so the
+            // send is complete as far as the sender is concerned.
+            pending_send finished = *current;
+            {
+                std::lock_guard<std::mutex> lock(group.sends_mutex);
+                group.sends.pop_front();
+            }
+            group.completion_callback(finished.message.buffer, finished.length);
+        }
+    }
+}
+
+bool SharedMemoryTransport::make_receive_progress(group_state& group) {
+    ring_control* control = group.control();
+    std::atomic<uint64_t>& my_read_count = control->blocks_read[group.reader_index].value;
+    bool progress = false;
+    while(true) {
+        uint64_t read = my_read_count.load(std::memory_order_relaxed);
+        if(read == control->blocks_written.value.load(std::memory_order_acquire)) {
+            return progress;
+        }
+        char* slot = group.slot(read % ring_slots);
+        const slot_header* h = (const slot_header*)slot;
+        if(h->message_offset == 0) {
+            group.destination = group.incoming_receive(h->message_length);
+        }
+        char* message_start = group.destination.buffer;
+        memcpy(message_start + h->message_offset, slot + sizeof(slot_header), h->block_length);
+        bool last_block = h->message_offset + h->block_length == h->message_length;
+        size_t message_length = h->message_length;
+        my_read_count.store(read + 1, std::memory_order_release);
+        progress = true;
+
+        if(last_block) {
+            group.completion_callback(message_start, message_length);
+        }
+    }
+}
+
+void SharedMemoryTransport::wake_worker() {
+    {
+        std::lock_guard<std::mutex> lock(worker_mutex);
+        work_pending = true;
+    }
+    work_cv.notify_all();
+}
+
+void SharedMemoryTransport::work_loop() {
+    std::vector<std::shared_ptr<group_state>> active_groups;
+    unsigned int idle_rounds = 0;
+    auto idle_sleep = MIN_IDLE_SLEEP;
+    while(!thread_shutdown) {
+        active_groups.clear();
+        {
+            std::lock_guard<std::mutex> lock(groups_mutex);
+            for(const auto& p : groups) {
+                active_groups.push_back(p.second);
+            }
+        }
+        bool progress = false;
+        for(auto& group : active_groups) {
+            if(group->reader_index < 0) {
+                progress = make_send_progress(*group) || progress;
+            } else {
+                progress = make_receive_progress(*group) || progress;
+            }
+        }
+        bool have_groups = !active_groups.empty();
+        active_groups.clear();
+        std::unique_lock<std::mutex> lock(worker_mutex);
+        released_cv.notify_all();
+        if(progress || work_pending) {
+            work_pending = false;
+            idle_rounds = 0;
+            idle_sleep = MIN_IDLE_SLEEP;
+            continue;
+        }
+        if(++idle_rounds < IDLE_SPINS) {
+            lock.unlock();
+            std::this_thread::yield();
+            continue;
+        }
+        auto woken = [this]() { return work_pending || thread_shutdown; };
+        if(!have_groups) {
+            work_cv.wait(lock, woken);
+        } else {
+            work_cv.wait_for(lock, idle_sleep, woken);
+            idle_sleep = std::min(idle_sleep * 2, MAX_IDLE_SLEEP);
+        }
+    }
+}
+
+}  // namespace derecho
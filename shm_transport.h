@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "transport.h"
+
+namespace derecho {
+
+/**
+ * A MulticastTransport for members that are separate processes on the same
+ * host. Each group is backed by a POSIX shared memory segment holding a ring
+ * of block_size slots: the sender copies a message into the ring one block at
+ * a time, and each receiver copies blocks out of the ring into the buffer it
+ * was given by the incoming-message callback. The sender may only reuse a
+ * slot once every receiver has read it.
+ *
+ * No NIC is involved, so buffers do not need to be registered and the
+ * multicast path runs at memory speed. The send algorithm requested by the
+ * caller is ignored, since every receiver reads the sender's ring directly.
+ *
+ * The worker thread polls the rings while there is traffic. Once it has
+ * found nothing to do for IDLE_SPINS rounds it sleeps between polls, for
+ * twice as long each time up to MAX_IDLE_SLEEP, so an idle transport doesn't
+ * keep a core busy; a local send wakes it at once, but a message from
+ * another process may wait up to MAX_IDLE_SLEEP to be noticed after a lull.
+ * With no groups at all the worker sleeps until one is created.
+ *
+ * Segments are named <name_prefix>_<session token>_<group_number>_<sender id>,
+ * so groups of different runs on the same host never share one. Only the
+ * sender creates a segment, replacing any leftover of the same name and
+ * initializing the ring before marking it ready; receivers wait for it to
+ * be ready. The sender unlinks it when the group is destroyed.
+ */
+class SharedMemoryTransport : public MulticastTransport {
+public:
+    /** Upper bound on the number of receivers in one group. */
+    static constexpr unsigned int MAX_RING_READERS = 64;
+    /** How long a receiver waits for the sender to create a group's segment. */
+    static constexpr std::chrono::seconds SEGMENT_WAIT{30};
+    /** Rounds without progress before the worker starts to sleep. */
+    static constexpr unsigned int IDLE_SPINS = 1000;
+    static constexpr std::chrono::microseconds MIN_IDLE_SLEEP{10};
+    static constexpr std::chrono::microseconds MAX_IDLE_SLEEP{1000};
+
+private:
+    struct alignas(64) padded_counter {
+        std::atomic<uint64_t> value;
+    };
+
+    /** Lives at the start of each shared memory segment. */
+    struct ring_control {
+        /** Set to SEGMENT_READY by the sender once the rest is initialized. */
+        padded_counter ready;
+        /** Number of blocks the sender has written into the ring. */
+        padded_counter blocks_written;
+        /** blocks_read[i] is the number of blocks receiver i has consumed. */
+        padded_counter blocks_read[MAX_RING_READERS];
+    };
+
+    /** Precedes the data in each slot of the ring. */
+    struct slot_header {
+        uint64_t message_length;
+        uint64_t message_offset;
+        uint64_t block_length;
+    };
+
+    struct pending_send {
+        transport_buffer message;
+        size_t length;
+        size_t bytes_written;
+    };
+
+    struct group_state {
+        std::string segment_name;
+        size_t block_size;
+        size_t slot_size;
+        /** Number of receivers, i.e. members.size() - 1 */
+        unsigned int num_readers;
+        /** Position of this node among the receivers, or -1 if this node is the sender. */
+        int reader_index;
+        char* segment;
+        size_t segment_size;
+        incoming_message_callback_t incoming_receive;
+        completion_callback_t completion_callback;
+
+        /** Sender only: messages waiting to be copied into the ring. */
+        std::mutex sends_mutex;
+        std::deque<pending_send> sends;
+
+        /** Receiver only: where the message currently arriving is being placed. */
+        transport_buffer destination;
+
+        ring_control* control() { return (ring_control*)segment; }
+        char* slot(uint64_t block_number);
+    };
+
+    const uint32_t my_id;
+    const uint64_t session_token;
+    const std::string name_prefix;
+    const unsigned int ring_slots;
+
+    std::mutex groups_mutex;
+    std::map<uint16_t, std::shared_ptr<group_state>> groups;
+
+    std::atomic<bool> thread_shutdown{false};
+    /** Guards work_pending; work_cv wakes the sleeping worker, and
+     * released_cv tells destroy_group the worker has let go of the groups
+     * it was working on. */
+    std::mutex worker_mutex;
+    std::condition_variable work_cv;
+    std::condition_variable released_cv;
+    bool work_pending = false;
+    /** Copies blocks into and out of the rings of every group. */
+    std::thread worker_thread;
+
+    /** Creates and initializes the segment of a group this node sends in. */
+    char* create_segment(const group_state& group);
+    /** Maps the segment of a group this node receives in, once the sender
+     * has made it ready; null if it doesn't within SEGMENT_WAIT. */
+    char* open_segment(const group_state& group);
+    void work_loop();
+    /** Wakes the worker if it is sleeping. */
+    void wake_worker();
+    bool make_send_progress(group_state& group);
+    bool make_receive_progress(group_state& group);
+
+public:
+    SharedMemoryTransport(uint32_t my_id, uint64_t session_token,
+                          const std::string& name_prefix = "derecho",
+                          unsigned int ring_slots = 64);
+    ~SharedMemoryTransport();
+
+    bool create_group(uint16_t group_number, std::vector<uint32_t> members,
+                      size_t block_size, rdmc::send_algorithm algorithm,
+                      incoming_message_callback_t incoming_receive,
+                      completion_callback_t send_callback,
+                      failure_callback_t failure_callback) override;
+    void destroy_group(uint16_t group_number) override;
+    bool send(uint16_t group_number, const transport_buffer& message,
+              size_t length) override;
+    bool needs_registered_memory() const override { return false; }
+};
+
+}  // namespace derecho
@@ -0,0 +1,318 @@
+#include "tcp_transport.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace derecho {
+
+namespace {
+/** epoll user data for the wakeup eventfd; node IDs are 32 bits */
+const uint64_t wakeup_event = 1ull << 32;
+}  // namespace
+
+TcpTransport::TcpTransport(uint32_t my_id, const std::map<uint32_t, std::string>& ip_addrs,
+                           uint32_t port)
+    : my_id(my_id),
+      port(port),
+      conn_listener(std::make_unique<tcp::connection_listener>(port + my_id)) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(epoll_fd >= 0 && wakeup_fd >= 0);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = wakeup_event;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &event);
+    for(const auto& p : ip_addrs) {
+        if(p.first != my_id && !add_connection(p.first, p.second)) {
+            std::cerr << "WARNING: TCP transport failed to connect to node " << p.first
+                      << " at " << p.second << ":" << port + p.first << std::endl;
+        }
+    }
+    reader_thread = std::thread(&TcpTransport::read_loop, this);
+    writer_thread = std::thread(&TcpTransport::write_loop, this);
+}
+
+TcpTransport::~TcpTransport() {
+    thread_shutdown = true;
+    tasks_cv.notify_all();
+    uint64_t one = 1;
+    if(write(wakeup_fd, &one, sizeof(one)) < 0) {
+        std::cerr << "WARNING: failed to wake up the TCP transport's reader thread" << std::endl;
+    }
+    if(writer_thread.joinable()) {
+        writer_thread.join();
+    }
+    if(reader_thread.joinable()) {
+        reader_thread.join();
+    }
+    close(wakeup_fd);
+    close(epoll_fd);
+}
+
+bool TcpTransport::add_connection(uint32_t other_id, const std::string& other_ip) {
+    // Same convention as tcp_connections: the node with the higher ID
+    // initiates the connection, and the IDs are exchanged to identify it.
+    tcp::socket s;
+    if(other_id < my_id) {
+        try {
+            s = tcp::socket(other_ip, port + other_id);
+        } catch(tcp::exception) {
+            return false;
+        }
+    } else {
+        try {
+            s = conn_listener->accept();
+        } catch(tcp::exception) {
+            return false;
+        }
+    }
+    uint32_t remote_id = 0;
+    if(!s.exchange(my_id, remote_id)) {
+        return false;
+    }
+    auto shared_socket = std::make_shared<tcp::socket>(std::move(s));
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = remote_id;
+    std::lock_guard<std::mutex> lock(sockets_mutex);
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, shared_socket->get_socket(), &event) != 0) {
+        return false;
+    }
+    sockets[remote_id] = std::move(shared_socket);
+    return true;
+}
+
+std::shared_ptr<tcp::socket> TcpTransport::find_socket(uint32_t node_id) {
+    std::lock_guard<std::mutex> lock(sockets_mutex);
+    auto it = sockets.find(node_id);
+    if(it == sockets.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+void TcpTransport::drop_peer(uint32_t node_id) {
+    {
+        std::lock_guard<std::mutex> lock(sockets_mutex);
+        auto it = sockets.find(node_id);
+        if(it == sockets.end()) {
+            // Already dropped by the other thread
+            return;
+        }
+        int fd = it->second->get_socket();
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        // Fails any write in progress on the writer thread
+        shutdown(fd, SHUT_RDWR);
+        sockets.erase(it);
+    }
+    std::cerr << "WARNING: TCP transport lost its connection to node " << node_id << std::endl;
+    std::vector<std::shared_ptr<group_state>> affected;
+    {
+        std::lock_guard<std::mutex> lock(groups_mutex);
+        for(const auto& p : groups) {
+            const auto& members = p.second->members;
+            if(std::find(members.begin(), members.end(), node_id) != members.end()) {
+                affected.push_back(p.second);
+            }
+        }
+    }
+    for(const auto& group : affected) {
+        group->failure_callback(node_id);
+    }
+}
+
+void TcpTransport::add_node(uint32_t new_id, const std::string& new_ip) {
+    {
+        std::lock_guard<std::mutex> lock(sockets_mutex);
+        if(new_id == my_id || sockets.count(new_id)) {
+            return;
+        }
+    }
+    if(!add_connection(new_id, new_ip)) {
+        std::cerr << "WARNING: TCP transport failed to connect to node " << new_id
+                  << " at " << new_ip << ":" << port + new_id << std::endl;
+    }
+}
+
+std::vector<uint32_t> TcpTransport::compute_children(const std::vector<uint32_t>& members,
+                                                     size_t my_position,
+                                                     rdmc::send_algorithm algorithm) {
+    std::vector<uint32_t> children;
+    const size_t n = members.size();
+    switch(algorithm) {
+        case rdmc::SEQUENTIAL_SEND:
+            if(my_position == 0) {
+                children.assign(members.begin() + 1, members.end());
+            }
+            break;
+        case rdmc::CHAIN_SEND:
+            if(my_position + 1 < n) {
+                children.push_back(members[my_position + 1]);
+            }
+            break;
+        case rdmc::TREE_SEND:
+            for(size_t child = 2 * my_position + 1; child <= 2 * my_position + 2 && child < n; ++child) {
+                children.push_back(members[child]);
+            }
+            break;
+        case rdmc::BINOMIAL_SEND:
+        default:
+            // Position p is the parent of p + 2^k for every 2^k > p, so
+            // the sender reaches half the group in its first hop.
+            for(size_t step = 1; my_position + step < n; step *= 2) {
+                if(step > my_position) {
+                    children.push_back(members[my_position + step]);
+                }
+            }
+            break;
+    }
+    return children;
+}
+
+bool TcpTransport::create_group(uint16_t group_number, std::vector<uint32_t> members,
+                                size_t block_size, rdmc::send_algorithm algorithm,
+                                incoming_message_callback_t incoming_receive,
+                                completion_callback_t send_callback,
+                                failure_callback_t failure_callback) {
+    auto my_position = std::find(members.begin(), members.end(), my_id);
+    if(my_position == members.end() || block_size == 0) {
+        return false;
+    }
+    auto group = std::make_shared<group_state>();
+    group->members = members;
+    group->children = compute_children(members, std::distance(members.begin(), my_position), algorithm);
+    group->block_size = block_size;
+    group->is_sender = my_position == members.begin();
+    group->incoming_receive = incoming_receive;
+    group->completion_callback = send_callback;
+    group->failure_callback = failure_callback;
+    group->destination = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(sockets_mutex);
+        for(auto child : group->children) {
+            if(!sockets.count(child)) {
+                return false;
+            }
+        }
+    }
+    std::lock_guard<std::mutex> lock(groups_mutex);
+    return groups.emplace(group_number, group).second;
+}
+
+void TcpTransport::destroy_group(uint16_t group_number) {
+    std::lock_guard<std::mutex> lock(groups_mutex);
+    groups.erase(group_number);
+}
+
+std::shared_ptr<TcpTransport::group_state> TcpTransport::find_group(uint16_t group_number) {
+    std::lock_guard<std::mutex> lock(groups_mutex);
+    auto it = groups.find(group_number);
+    if(it == groups.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+void TcpTransport::enqueue(const block_task& task) {
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        tasks.push(task);
+    }
+    tasks_cv.notify_one();
+}
+
+bool TcpTransport::send(uint16_t group_number, const transport_buffer& message,
+                        size_t length) {
+    auto group = find_group(group_number);
+    if(!group || !group->is_sender || length == 0) {
+        return false;
+    }
+    char* data = message.buffer;
+    for(size_t offset = 0; offset < length; offset += group->block_size) {
+        enqueue({group_number, data, length, offset,
+                 std::min(group->block_size, length - offset)});
+    }
+    return true;
+}
+
+void TcpTransport::write_loop() {
+    std::unique_lock<std::mutex> lock(tasks_mutex);
+    while(!thread_shutdown) {
+        tasks_cv.wait(lock, [this]() { return thread_shutdown || !tasks.empty(); });
+        if(thread_shutdown) {
+            break;
+        }
+        block_task task = tasks.front();
+        tasks.pop();
+        lock.unlock();
+
+        auto group = find_group(task.group_number);
+        if(group) {
+            block_frame frame{task.group_number, task.message_length, task.offset, task.length};
+            for(auto child : group->children) {
+                std::shared_ptr<tcp::socket> s = find_socket(child);
+                if(!s) {
+                    continue;
+                }
+                if(!s->write((char*)&frame, sizeof(frame)) || !s->write(task.message + task.offset, task.length)) {
+                    drop_peer(child);
+                }
+            }
+            if(task.offset + task.length == task.message_length) {
+                group->completion_callback(task.message, task.message_length);
+            }
+        }
+        lock.lock();
+    }
+}
+
+bool TcpTransport::receive_block(tcp::socket& s, std::vector<char>& discard_buffer) {
+    block_frame frame;
+    if(!s.read((char*)&frame, sizeof(frame))) {
+        return false;
+    }
+    auto group = find_group(frame.group_number);
+    if(!group || group->is_sender) {
+        // The group was destroyed while this block was in flight; consume
+        // it so the stream stays framed correctly.
+        discard_buffer.resize(frame.length);
+        return s.read(discard_buffer.data(), frame.length);
+    }
+    if(frame.offset == 0) {
+        transport_buffer destination = group->incoming_receive(frame.message_length);
+        group->destination = destination.buffer;
+    }
+    if(!s.read(group->destination + frame.offset, frame.length)) {
+        return false;
+    }
+    // Relaying (and the completion callback) happen on the writer thread, in
+    // the order the blocks arrived.
+    enqueue({frame.group_number, group->destination, frame.message_length,
+             frame.offset, frame.length});
+    return true;
+}
+
+void TcpTransport::read_loop() {
+    std::vector<char> discard_buffer;
+    epoll_event events[64];
+    while(!thread_shutdown) {
+        int num_events = epoll_wait(epoll_fd, events, 64, -1);
+        for(int i = 0; i < num_events && !thread_shutdown; ++i) {
+            if(events[i].data.u64 == wakeup_event) {
+                continue;
+            }
+            uint32_t node_id = (uint32_t)events[i].data.u64;
+            std::shared_ptr<tcp::socket> s = find_socket(node_id);
+            if(s && !receive_block(*s, discard_buffer)) {
+                drop_peer(node_id);
+            }
+        }
+    }
+}
+
+}  // namespace derecho
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rdmc/connection.h"
+#include "transport.h"
+
+namespace derecho {
+
+/**
+ * A MulticastTransport that moves messages over ordinary TCP sockets, for
+ * networks where RDMC's multicast isn't wanted and for benchmarking over
+ * loopback (the SST still needs RDMA verbs; see transport_type). Messages
+ * are split into block_size blocks and relayed along an overlay tree chosen by the
+ * send algorithm; a member forwards each block to its children as soon as it
+ * arrives, so large messages are pipelined just like they are in RDMC.
+ *
+ *  - SEQUENTIAL_SEND: the sender sends every block to every receiver.
+ *  - CHAIN_SEND: each member forwards to the next member in the list.
+ *  - TREE_SEND: a binary tree rooted at the sender.
+ *  - BINOMIAL_SEND: a binomial tree rooted at the sender. This is the tree
+ *    underlying RDMC's binomial pipeline, but blocks are relayed down the
+ *    tree rather than exchanged between peers.
+ *
+ * Each node listens on port + its node ID, so any number of members can run
+ * on one host and talk over 127.0.0.1.
+ *
+ * One thread reads blocks from every peer and never writes, and one thread
+ * does all the writing, so two members relaying to each other can't block
+ * each other's reads. The reader sleeps in epoll until a peer has data. A
+ * member's completion callback is issued only after it has forwarded the
+ * last block of the message to its children, since the buffer may be reused
+ * as soon as the callback returns.
+ *
+ * If a read from or write to a peer fails, the connection is dropped and the
+ * failure callback of every group the peer belongs to is called; a message
+ * that was only partly received is never completed.
+ */
+class TcpTransport : public MulticastTransport {
+    struct __attribute__((__packed__)) block_frame {
+        uint16_t group_number;
+        uint64_t message_length;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    struct group_state {
+        std::vector<uint32_t> members;
+        /** Node IDs of the members this node relays blocks to. */
+        std::vector<uint32_t> children;
+        size_t block_size;
+        bool is_sender;
+        incoming_message_callback_t incoming_receive;
+        completion_callback_t completion_callback;
+        failure_callback_t failure_callback;
+        /** Receivers only: the buffer the current message is being written into. */
+        char* destination;
+    };
+
+    /** A unit of work for the writer thread: send (or relay) one block of a
+     * message to this node's children in a group. */
+    struct block_task {
+        uint16_t group_number;
+        char* message;
+        size_t message_length;
+        size_t offset;
+        size_t length;
+    };
+
+    const uint32_t my_id;
+    const uint32_t port;
+    std::unique_ptr<tcp::connection_listener> conn_listener;
+
+    std::mutex sockets_mutex;
+    /** Shared so the writer thread can keep using a socket that the reader
+     * thread drops. */
+    std::map<uint32_t, std::shared_ptr<tcp::socket>> sockets;
+    /** epoll instance watching every socket for incoming blocks */
+    int epoll_fd;
+    /** eventfd used to wake up the reader thread for shutdown */
+    int wakeup_fd;
+
+    std::mutex groups_mutex;
+    std::map<uint16_t, std::shared_ptr<group_state>> groups;
+
+    std::mutex tasks_mutex;
+    std::condition_variable tasks_cv;
+    std::queue<block_task> tasks;
+
+    std::atomic<bool> thread_shutdown{false};
+    std::thread reader_thread;
+    std::thread writer_thread;
+
+    bool add_connection(uint32_t other_id, const std::string& other_ip);
+    std::shared_ptr<tcp::socket> find_socket(uint32_t node_id);
+    /** Closes the connection to node_id and reports it to every group the
+     * node is a member of. */
+    void drop_peer(uint32_t node_id);
+    /** Reads one block from s; false if the connection failed. */
+    bool receive_block(tcp::socket& s, std::vector<char>& discard_buffer);
+    std::shared_ptr<group_state> find_group(uint16_t group_number);
+    void enqueue(const block_task& task);
+    void read_loop();
+    void write_loop();
+    static std::vector<uint32_t> compute_children(const std::vector<uint32_t>& members,
+                                                  size_t my_position,
+                                                  rdmc::send_algorithm algorithm);
+
+public:
+    TcpTransport(uint32_t my_id, const std::map<uint32_t, std::string>& ip_addrs,
+                 uint32_t port);
+    ~TcpTransport();
+
+    bool create_group(uint16_t group_number, std::vector<uint32_t> members,
+                      size_t block_size, rdmc::send_algorithm algorithm,
+                      incoming_message_callback_t incoming_receive,
+                      completion_callback_t send_callback,
+                      failure_callback_t failure_callback) override;
+    void destroy_group(uint16_t group_number) override;
+    bool send(uint16_t group_number, const transport_buffer& message,
+              size_t length) override;
+    bool needs_registered_memory() const override { return false; }
+    void add_node(uint32_t new_id, const std::string& new_ip) override;
+};
+
+}  // namespace derecho
@@ -0,0 +1,28 @@
+#include "transport.h"
+#include "shm_transport.h"
+#include "tcp_transport.h"
+
+#include <random>
+
+namespace derecho {
+
+std::shared_ptr<MulticastTransport> make_transport(transport_type type, uint32_t my_id,
+                                                   const std::map<uint32_t, std::string>& ip_addrs,
+                                                   uint32_t port, uint64_t session_token) {
+    switch(type) {
+        case SHARED_MEMORY_TRANSPORT:
+            return std::make_shared<SharedMemoryTransport>(my_id, session_token);
+        case TCP_TRANSPORT:
+            return std::make_shared<TcpTransport>(my_id, ip_addrs, port);
+        case RDMC_TRANSPORT:
+        default:
+            return std::make_shared<RDMCTransport>();
+    }
+}
+
+uint64_t new_session_token() {
+    std::random_device random;
+    return ((uint64_t)random() << 32) | random();
+}
+
+}  // namespace derecho
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rdmc/rdmc.h"
+
+namespace derecho {
+
+/**
+ * Selects the data plane that DerechoGroup uses to move message bodies from a
+ * sender to the rest of the group. The ordering protocol (SST predicates,
+ * windows, delivery) is the same regardless of which one is chosen.
+ *
+ * None of them removes the need for RDMA: the SST itself still runs over
+ * RDMA verbs, so every member needs an RDMA NIC (InfiniBand or RoCE; a
+ * software RoCE device such as rdma_rxe will do for tests) whichever
+ * transport moves the messages. The alternatives take RDMC, and its
+ * registered memory and pinned buffers, out of the message path, which is
+ * what they are for: comparing data planes, and running the multicast over
+ * loopback or plain Ethernet. Only RDMC_TRANSPORT initializes RDMC.
+ */
+enum transport_type : uint32_t {
+    /** RDMC over InfiniBand verbs; the default. */
+    RDMC_TRANSPORT = 0,
+    /** Shared-memory rings between processes on the same host. */
+    SHARED_MEMORY_TRANSPORT = 1,
+    /** Blocks relayed over TCP sockets. */
+    TCP_TRANSPORT = 2,
+};
+
+/**
+ * Identifies a buffer that a transport reads a message from or writes a
+ * message into. RDMA-based transports use the memory region and offset; other
+ * transports only need the local address.
+ */
+struct transport_buffer {
+    /** Address of the first byte of the buffer. */
+    char* buffer;
+    /** The registered memory region containing the buffer, or null if the
+     * buffer was not registered with the NIC. */
+    std::shared_ptr<rdma::memory_region> mr;
+    /** Offset of buffer within mr. */
+    size_t offset;
+};
+
+using incoming_message_callback_t = std::function<transport_buffer(size_t length)>;
+using completion_callback_t = std::function<void(char* data, size_t size)>;
+using failure_callback_t = std::function<void(boost::optional<uint32_t>)>;
+
+/**
+ * The multicast contract DerechoGroup relies on: one group per sender, with
+ * the sender at position 0 of the members list. Every member other than the
+ * sender is asked for a receive_destination when a message starts arriving,
+ * and every member (including the sender) gets a completion callback when the
+ * message is complete at that member. Completion callbacks for one group are
+ * issued in the order the messages were sent.
+ */
+class MulticastTransport {
+public:
+    virtual ~MulticastTransport() = default;
+
+    virtual bool create_group(uint16_t group_number, std::vector<uint32_t> members,
+                              size_t block_size, rdmc::send_algorithm algorithm,
+                              incoming_message_callback_t incoming_receive,
+                              completion_callback_t send_callback,
+                              failure_callback_t failure_callback) = 0;
+    virtual void destroy_group(uint16_t group_number) = 0;
+    virtual bool send(uint16_t group_number, const transport_buffer& message,
+                      size_t length) = 0;
+    /** True if buffers handed to this transport must be registered with the
+     * RDMA NIC, i.e. MessageBuffers need an rdma::memory_region. */
+    virtual bool needs_registered_memory() const = 0;
+    /** Called when a node joins the group, so that transports which keep
+     * their own connections can connect to it. */
+    virtual void add_node(uint32_t new_id, const std::string& new_ip) {}
+};
+
+/**
+ * The default transport: a thin adapter over the global RDMC instance, which
+ * must already have been set up with rdmc::initialize.
+ */
+class RDMCTransport : public MulticastTransport {
+public:
+    bool create_group(uint16_t group_number, std::vector<uint32_t> members,
+                      size_t block_size, rdmc::send_algorithm algorithm,
+                      incoming_message_callback_t incoming_receive,
+                      completion_callback_t send_callback,
+                      failure_callback_t failure_callback) override {
+        return rdmc::create_group(
+            group_number, members, block_size, algorithm,
+            [incoming_receive](size_t length) -> rdmc::receive_destination {
+                transport_buffer destination = incoming_receive(length);
+                return {destination.mr, destination.offset};
+            },
+            send_callback, failure_callback);
+    }
+    void destroy_group(uint16_t group_number) override {
+        rdmc::destroy_group(group_number);
+    }
+    bool send(uint16_t group_number, const transport_buffer& message,
+              size_t length) override {
+        return rdmc::send(group_number, message.mr, message.offset, length);
+    }
+    bool needs_registered_memory() const override { return true; }
+};
+
+/**
+ * Constructs the transport identified by type for the node my_id. Transports
+ * that make their own connections use ip_addrs and port to reach the other
+ * members; those that name shared resources include session_token (see
+ * DerechoParams::session_token) in the names. Defined in transport.cpp.
+ */
+std::shared_ptr<MulticastTransport> make_transport(transport_type type, uint32_t my_id,
+                                                   const std::map<uint32_t, std::string>& ip_addrs,
+                                                   uint32_t port, uint64_t session_token);
+
+/** A random token for a new run of a group; see DerechoParams::session_token. */
+uint64_t new_session_token();
+
+}  // namespace derecho
@@ -1,3 +1,4 @@
+#include <fstream>
 #include <memory>
 #include <iostream>
 #include <iterator>
@@ -131,14 +132,14 @@ void View<handlersType>::merge_changes() {
             gmssst::increment((*gmsSST)[myRank].nChanges);
         }
     }
-    gmsSST->put();
+    gmssst::put_used(*gmsSST);
 }
 
 template<typename handlersType>
 void View<handlersType>::wedge() {
     derecho_group->wedge();  // RDMC finishes sending, stops new sends or receives in Vc
     gmssst::set((*gmsSST)[my_rank].wedged, true);
-    gmsSST->put();
+    gmssst::put_used(*gmsSST);
 }
 
 template <typename handlersType>